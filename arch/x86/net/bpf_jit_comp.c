@@ -0,0 +1,835 @@
+/* bpf_jit_comp.c : BPF JIT compiler
+ *
+ * Translates a socket filter, once validated by sk_chk_filter(), into
+ * x86_64 native code. Filters using an instruction or an ancillary
+ * load the compiler does not know about keep running in sk_run_filter().
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+#include <linux/moduleloader.h>
+#include <linux/workqueue.h>
+#include <linux/netdevice.h>
+#include <linux/filter.h>
+#include <linux/skbuff.h>
+#include <linux/slab.h>
+#include <net/netlink.h>
+#include <asm/cacheflush.h>
+#include <asm/unaligned.h>
+
+int bpf_jit_enable __read_mostly;
+
+/*
+ * Register and stack usage of the generated code :
+ *
+ * eax        : A accumulator
+ * ebx        : X index register (callee saved, restored on exit)
+ * rdi        : skb pointer, reloaded from the frame after each helper call
+ * esi        : offset of a packet load
+ * rcx        : end of a packet load, checked against the headlen
+ * r12        : skb->data (callee saved, restored on exit)
+ * r13        : skb headlen, skb->len - skb->data_len (ditto)
+ * -8(%rbp)   : saved rbx
+ * -16(%rbp)  : saved skb pointer
+ * -20(%rbp)  : A, saved across the BPF_LDX|BPF_B|BPF_MSH helper call
+ * -32(%rbp)  : saved r12
+ * -40(%rbp)  : saved r13
+ * -104(%rbp) : mem[BPF_MEMWORDS] scratch memory
+ */
+#define BPF_FRAME_SIZE	112
+#define BPF_RBX_OFF	(-8)
+#define BPF_SKB_OFF	(-16)
+#define BPF_A_OFF	(-20)
+#define BPF_R12_OFF	(-32)
+#define BPF_R13_OFF	(-40)
+#define BPF_MEM_OFF	(-104)
+
+/*
+ * Packet load helpers, the slow path of the generated code for loads
+ * which are not within the linear skb data. They return the loaded value
+ * zero extended, or BPF_LOAD_FAIL if it is out of the packet: its low 32
+ * bits are clear so that the generated code can return it as the filter
+ * result, and its sign bit is set so a single test finds it.
+ *
+ * As in sk_run_filter(), an offset in the ancillary range fetches the
+ * ancillary data, which needs A and X for the netlink lookups. Only
+ * indirect loads get there: absolute ancillary loads are translated
+ * inline, or leave the filter to the interpreter.
+ */
+#define BPF_LOAD_FAIL	(1ULL << 63)
+
+static inline void *bpf_load_pointer(const struct sk_buff *skb, int k,
+				     unsigned int size, void *buffer)
+{
+	if (k >= 0)
+		return skb_header_pointer(skb, k, size, buffer);
+	if (k >= SKF_AD_OFF)
+		return NULL;
+	return bpf_internal_load_pointer_neg_helper(skb, k, size);
+}
+
+/* see the ancillary switch in sk_run_filter() */
+static u64 bpf_jit_load_ancillary(const struct sk_buff *skb, int k,
+				  u32 A, u32 X)
+{
+	struct nlattr *nla;
+
+	switch (k - SKF_AD_OFF) {
+	case SKF_AD_PROTOCOL:
+		return ntohs(skb->protocol);
+	case SKF_AD_PKTTYPE:
+		return skb->pkt_type;
+	case SKF_AD_IFINDEX:
+		if (unlikely(!skb->dev))
+			return BPF_LOAD_FAIL;
+		return skb->dev->ifindex;
+	case SKF_AD_MARK:
+		return skb->mark;
+	case SKF_AD_QUEUE:
+		return skb->queue_mapping;
+	case SKF_AD_NLATTR:
+		if (skb_is_nonlinear(skb))
+			return BPF_LOAD_FAIL;
+		if (A > skb->len - sizeof(struct nlattr))
+			return BPF_LOAD_FAIL;
+
+		nla = nla_find((struct nlattr *)&skb->data[A],
+			       skb->len - A, X);
+		return nla ? (void *)nla - (void *)skb->data : 0;
+	case SKF_AD_NLATTR_NEST:
+		if (skb_is_nonlinear(skb))
+			return BPF_LOAD_FAIL;
+		if (A > skb->len - sizeof(struct nlattr))
+			return BPF_LOAD_FAIL;
+
+		nla = (struct nlattr *)&skb->data[A];
+		if (nla->nla_len > A - skb->len)
+			return BPF_LOAD_FAIL;
+
+		nla = nla_find_nested(nla, X);
+		return nla ? (void *)nla - (void *)skb->data : 0;
+	}
+	return BPF_LOAD_FAIL;
+}
+
+static u64 bpf_jit_load_word(const struct sk_buff *skb, int k, u32 A, u32 X)
+{
+	u32 tmp;
+	void *ptr;
+
+	if (unlikely(k < 0 && k >= SKF_AD_OFF))
+		return bpf_jit_load_ancillary(skb, k, A, X);
+	ptr = bpf_load_pointer(skb, k, 4, &tmp);
+	if (unlikely(!ptr))
+		return BPF_LOAD_FAIL;
+	return get_unaligned_be32(ptr);
+}
+
+static u64 bpf_jit_load_half(const struct sk_buff *skb, int k, u32 A, u32 X)
+{
+	u16 tmp;
+	void *ptr;
+
+	if (unlikely(k < 0 && k >= SKF_AD_OFF))
+		return bpf_jit_load_ancillary(skb, k, A, X);
+	ptr = bpf_load_pointer(skb, k, 2, &tmp);
+	if (unlikely(!ptr))
+		return BPF_LOAD_FAIL;
+	return get_unaligned_be16(ptr);
+}
+
+static u64 bpf_jit_load_byte(const struct sk_buff *skb, int k, u32 A, u32 X)
+{
+	u8 tmp;
+	u8 *ptr;
+
+	if (unlikely(k < 0 && k >= SKF_AD_OFF))
+		return bpf_jit_load_ancillary(skb, k, A, X);
+	ptr = bpf_load_pointer(skb, k, 1, &tmp);
+	if (unlikely(!ptr))
+		return BPF_LOAD_FAIL;
+	return *ptr;
+}
+
+static u64 bpf_jit_load_byte_msh(const struct sk_buff *skb, int k)
+{
+	u8 tmp;
+	u8 *ptr = bpf_load_pointer(skb, k, 1, &tmp);
+
+	if (unlikely(!ptr))
+		return BPF_LOAD_FAIL;
+	return (*ptr & 0xf) << 2;
+}
+
+static inline u8 *emit_code(u8 *ptr, u32 bytes, unsigned int len)
+{
+	if (len == 1)
+		*ptr = bytes;
+	else if (len == 2)
+		*(u16 *)ptr = bytes;
+	else {
+		*(u32 *)ptr = bytes;
+		barrier();
+	}
+	return ptr + len;
+}
+
+#define EMIT(bytes, len)	do { prog = emit_code(prog, bytes, len); } while (0)
+
+#define EMIT1(b1)		EMIT((u8)(b1), 1)
+#define EMIT2(b1, b2)		EMIT((u8)(b1) + ((u8)(b2) << 8), 2)
+#define EMIT3(b1, b2, b3)	EMIT((u8)(b1) + ((u8)(b2) << 8) + \
+				     ((u8)(b3) << 16), 3)
+#define EMIT4(b1, b2, b3, b4)	EMIT((u8)(b1) + ((u8)(b2) << 8) + \
+				     ((u8)(b3) << 16) + ((u32)(u8)(b4) << 24), 4)
+#define EMIT1_off32(b1, off)	do { EMIT1(b1); EMIT(off, 4); } while (0)
+
+#define CLEAR_A() EMIT2(0x31, 0xc0) /* xor %eax,%eax */
+#define CLEAR_X() EMIT2(0x31, 0xdb) /* xor %ebx,%ebx */
+
+/* offset in the image of the next emitted byte */
+#define PROG_OFF()	(proglen + (prog - temp))
+
+static inline bool is_imm8(int value)
+{
+	return value <= 127 && value >= -128;
+}
+
+static inline bool is_near(int offset)
+{
+	return offset <= 127 && offset >= -128;
+}
+
+/* jmp to image offset 'target' */
+#define EMIT_JMP(target)						\
+do {									\
+	int __off = (target) - (PROG_OFF() + 2);			\
+									\
+	if (is_near(__off))						\
+		EMIT2(0xeb, __off);		/* jmp .+off8 */	\
+	else {								\
+		__off = (target) - (PROG_OFF() + 5);			\
+		EMIT1_off32(0xe9, __off);	/* jmp .+off32 */	\
+	}								\
+} while (0)
+
+/* list of x86 cond jumps opcodes (. + s8)
+ * Add 0x10 (and an extra 0x0f) to generate far jumps (. + s32)
+ */
+#define X86_JB  0x72
+#define X86_JAE 0x73
+#define X86_JE  0x74
+#define X86_JNE 0x75
+#define X86_JBE 0x76
+#define X86_JA  0x77
+#define X86_JS  0x78
+
+/* jcc to image offset 'target' */
+#define EMIT_COND_JMP(op, target)					\
+do {									\
+	int __off = (target) - (PROG_OFF() + 2);			\
+									\
+	if (is_near(__off))						\
+		EMIT2(op, __off);		/* jxx .+off8 */	\
+	else {								\
+		__off = (target) - (PROG_OFF() + 6);			\
+		EMIT2(0x0f, (op) + 0x10);				\
+		EMIT(__off, 4);			/* jxx .+off32 */	\
+	}								\
+} while (0)
+
+/*
+ * call a load helper, then reload skb into %rdi and return 0 from the
+ * filter if the load failed. Always LOAD_CALL_LEN bytes long, so that
+ * the fast path of a packet load can jump over it.
+ */
+#define LOAD_CALL_LEN	18
+#define EMIT_LOAD_CALL(func)						\
+do {									\
+	int __off = (unsigned long)(func) -				\
+		    ((unsigned long)image + PROG_OFF() + 5);		\
+									\
+	EMIT1_off32(0xe8, __off);		/* call func */		\
+	EMIT4(0x48, 0x8b, 0x7d, BPF_SKB_OFF);	/* mov -16(%rbp),%rdi */ \
+	EMIT3(0x48, 0x85, 0xc0);		/* test %rax,%rax */	\
+	EMIT2(0x0f, X86_JS + 0x10);		/* js cleanup */	\
+	EMIT(cleanup_addr - (PROG_OFF() + 4), 4);			\
+} while (0)
+
+/*
+ * The bytes [%rsi, %rsi + len) are in the linear skb data if they end
+ * before the headlen. %rsi is the zero extended 32 bit offset, so that
+ * negative offsets fail the check as well and are left to the helpers.
+ */
+#define EMIT_HEADLEN_CHECK(len)						\
+do {									\
+	EMIT4(0x48, 0x8d, 0x4e, len);	/* lea len(%rsi),%rcx */	\
+	EMIT3(0x4c, 0x39, 0xe9);	/* cmp %r13,%rcx */		\
+} while (0)
+
+/* op off(%rdi),reg with an 8 or 32 bit displacement; modrm reg in b3 */
+#define EMIT_RDI_OFF(b1, b2, b3, off)					\
+do {									\
+	if (is_imm8(off))						\
+		EMIT4(b1, b2, 0x47 | (b3), off);			\
+	else {								\
+		EMIT3(b1, b2, 0x87 | (b3));				\
+		EMIT(off, 4);						\
+	}								\
+} while (0)
+
+#define COND_SEL(CODE, TOP, FOP)	\
+	case CODE:			\
+		t_op = TOP;		\
+		f_op = FOP;		\
+		goto cond_branch
+
+#define SEEN_DATAREF 1 /* loads from the packet, uses r12/r13 */
+#define SEEN_XREG    2 /* ebx is used */
+#define SEEN_MEM     4 /* use mem[] for temporary storage */
+
+void bpf_jit_compile(struct sk_filter *fp)
+{
+	u8 temp[128];	/* prologue and first instruction */
+	u8 *prog;
+	unsigned int proglen, oldproglen = 0;
+	int ilen, i;
+	int t_offset;
+	u8 t_op, f_op, seen = 0, pass;
+	u8 *image = NULL;
+	u64 (*func)(const struct sk_buff *skb, int k, u32 A, u32 X);
+	unsigned int cleanup_addr; /* epilogue code offset */
+	unsigned int *addrs;
+	const struct sock_filter *filter = fp->insns;
+	int flen = fp->len;
+
+	if (!bpf_jit_enable)
+		return;
+
+	addrs = kmalloc(flen * sizeof(*addrs), GFP_KERNEL);
+	if (addrs == NULL)
+		return;
+
+	/* Before first pass, make a rough estimation of addrs[]
+	 * each bpf instruction is translated to less than 64 bytes
+	 */
+	for (proglen = 0, i = 0; i < flen; i++) {
+		proglen += 64;
+		addrs[i] = proglen;
+	}
+	cleanup_addr = proglen; /* epilogue address */
+
+	for (pass = 0; pass < 10; pass++) {
+		/*
+		 * The first pass discovers what the filter uses, assume
+		 * it needs the full prologue meanwhile.
+		 */
+		u8 seen_or_pass0 = (pass == 0) ?
+			(SEEN_DATAREF | SEEN_XREG | SEEN_MEM) : seen;
+
+		/* no prologue/epilogue for trivial filters (RET something) */
+		proglen = 0;
+		prog = temp;
+
+		if (seen_or_pass0) {
+			EMIT4(0x55, 0x48, 0x89, 0xe5); /* push %rbp; mov %rsp,%rbp */
+			EMIT4(0x48, 0x83, 0xec, BPF_FRAME_SIZE); /* subq $112,%rsp */
+			EMIT4(0x48, 0x89, 0x5d, BPF_RBX_OFF); /* mov %rbx,-8(%rbp) */
+			if (seen_or_pass0 & SEEN_DATAREF) {
+				/* mov %rdi,-16(%rbp) */
+				EMIT4(0x48, 0x89, 0x7d, BPF_SKB_OFF);
+				/* mov %r12,-32(%rbp) */
+				EMIT4(0x4c, 0x89, 0x65, BPF_R12_OFF);
+				/* mov %r13,-40(%rbp) */
+				EMIT4(0x4c, 0x89, 0x6d, BPF_R13_OFF);
+				/* mov data(%rdi),%r12 */
+				EMIT_RDI_OFF(0x4c, 0x8b, 0x20,
+					     offsetof(struct sk_buff, data));
+				/* mov len(%rdi),%r13d */
+				EMIT_RDI_OFF(0x44, 0x8b, 0x28,
+					     offsetof(struct sk_buff, len));
+				/* sub data_len(%rdi),%r13d */
+				EMIT_RDI_OFF(0x44, 0x2b, 0x28,
+					     offsetof(struct sk_buff, data_len));
+			}
+			if (seen_or_pass0 & SEEN_XREG)
+				CLEAR_X(); /* make sure we dont leak kernel memory */
+		}
+
+		switch (filter[0].code) {
+		case BPF_RET|BPF_K:
+		case BPF_LD|BPF_W|BPF_LEN:
+		case BPF_LD|BPF_IMM:
+		case BPF_LD|BPF_W|BPF_ABS:
+		case BPF_LD|BPF_H|BPF_ABS:
+		case BPF_LD|BPF_B|BPF_ABS:
+			/* first instruction sets A register (or is RET 'constant') */
+			break;
+		default:
+			/* make sure we dont leak kernel information to user */
+			CLEAR_A(); /* A = 0 */
+		}
+
+		for (i = 0; i < flen; i++) {
+			unsigned int K = filter[i].k;
+
+			switch (filter[i].code) {
+			case BPF_ALU|BPF_ADD|BPF_X: /* A += X; */
+				seen |= SEEN_XREG;
+				EMIT2(0x01, 0xd8);		/* add %ebx,%eax */
+				break;
+			case BPF_ALU|BPF_ADD|BPF_K: /* A += K; */
+				if (!K)
+					break;
+				if (is_imm8(K))
+					EMIT3(0x83, 0xc0, K);	/* add imm8,%eax */
+				else
+					EMIT1_off32(0x05, K);	/* add imm32,%eax */
+				break;
+			case BPF_ALU|BPF_SUB|BPF_X: /* A -= X; */
+				seen |= SEEN_XREG;
+				EMIT2(0x29, 0xd8);		/* sub %ebx,%eax */
+				break;
+			case BPF_ALU|BPF_SUB|BPF_K: /* A -= K */
+				if (!K)
+					break;
+				if (is_imm8(K))
+					EMIT3(0x83, 0xe8, K);	/* sub imm8,%eax */
+				else
+					EMIT1_off32(0x2d, K);	/* sub imm32,%eax */
+				break;
+			case BPF_ALU|BPF_MUL|BPF_X: /* A *= X; */
+				seen |= SEEN_XREG;
+				EMIT3(0x0f, 0xaf, 0xc3);	/* imul %ebx,%eax */
+				break;
+			case BPF_ALU|BPF_MUL|BPF_K: /* A *= K */
+				if (is_imm8(K))
+					EMIT3(0x6b, 0xc0, K);	/* imul imm8,%eax,%eax */
+				else {
+					EMIT2(0x69, 0xc0);	/* imul imm32,%eax,%eax */
+					EMIT(K, 4);
+				}
+				break;
+			case BPF_ALU|BPF_DIV|BPF_X: /* A /= X; */
+				seen |= SEEN_XREG;
+				EMIT2(0x85, 0xdb);	/* test %ebx,%ebx */
+				EMIT2(X86_JNE, 2 + 5);	/* jne .+7 */
+				CLEAR_A();		/* division by zero: return 0 */
+				t_offset = cleanup_addr - (PROG_OFF() + 5);
+				EMIT1_off32(0xe9, t_offset);	/* jmp cleanup */
+				EMIT4(0x31, 0xd2, 0xf7, 0xf3); /* xor %edx,%edx; div %ebx */
+				break;
+			case BPF_ALU|BPF_DIV|BPF_K: /* A /= K; (K != 0) */
+				EMIT2(0x31, 0xd2);	/* xor %edx,%edx */
+				EMIT1_off32(0xb9, K);	/* mov $imm32,%ecx */
+				EMIT2(0xf7, 0xf1);	/* div %ecx */
+				break;
+			case BPF_ALU|BPF_AND|BPF_X:
+				seen |= SEEN_XREG;
+				EMIT2(0x21, 0xd8);		/* and %ebx,%eax */
+				break;
+			case BPF_ALU|BPF_AND|BPF_K:
+				if (K >= 0xFFFFFF00) {
+					EMIT2(0x24, K & 0xFF);	/* and imm8,%al */
+				} else if (K >= 0xFFFF0000) {
+					EMIT2(0x66, 0x25);	/* and imm16,%ax */
+					EMIT(K, 2);
+				} else {
+					EMIT1_off32(0x25, K);	/* and imm32,%eax */
+				}
+				break;
+			case BPF_ALU|BPF_OR|BPF_X:
+				seen |= SEEN_XREG;
+				EMIT2(0x09, 0xd8);		/* or %ebx,%eax */
+				break;
+			case BPF_ALU|BPF_OR|BPF_K:
+				if (is_imm8(K))
+					EMIT3(0x83, 0xc8, K);	/* or imm8,%eax */
+				else
+					EMIT1_off32(0x0d, K);	/* or imm32,%eax */
+				break;
+			case BPF_ALU|BPF_LSH|BPF_X: /* A <<= X; */
+				seen |= SEEN_XREG;
+				EMIT4(0x89, 0xd9, 0xd3, 0xe0); /* mov %ebx,%ecx; shl %cl,%eax */
+				break;
+			case BPF_ALU|BPF_LSH|BPF_K:
+				if (K == 0)
+					break;
+				else if (K == 1)
+					EMIT2(0xd1, 0xe0);	/* shl %eax */
+				else
+					EMIT3(0xc1, 0xe0, K);	/* shl imm8,%eax */
+				break;
+			case BPF_ALU|BPF_RSH|BPF_X: /* A >>= X; */
+				seen |= SEEN_XREG;
+				EMIT4(0x89, 0xd9, 0xd3, 0xe8); /* mov %ebx,%ecx; shr %cl,%eax */
+				break;
+			case BPF_ALU|BPF_RSH|BPF_K: /* A >>= K; */
+				if (K == 0)
+					break;
+				else if (K == 1)
+					EMIT2(0xd1, 0xe8);	/* shr %eax */
+				else
+					EMIT3(0xc1, 0xe8, K);	/* shr imm8,%eax */
+				break;
+			case BPF_ALU|BPF_NEG:
+				EMIT2(0xf7, 0xd8);		/* neg %eax */
+				break;
+			case BPF_RET|BPF_K:
+				if (!K)
+					CLEAR_A();
+				else
+					EMIT1_off32(0xb8, K);	/* mov $imm32,%eax */
+				/* fallinto */
+			case BPF_RET|BPF_A:
+				if (seen_or_pass0) {
+					if (i != flen - 1) {
+						EMIT_JMP(cleanup_addr);
+						break;
+					}
+					if (seen_or_pass0 & SEEN_DATAREF) {
+						/* mov -32(%rbp),%r12 */
+						EMIT4(0x4c, 0x8b, 0x65, BPF_R12_OFF);
+						/* mov -40(%rbp),%r13 */
+						EMIT4(0x4c, 0x8b, 0x6d, BPF_R13_OFF);
+					}
+					/* mov -8(%rbp),%rbx */
+					EMIT4(0x48, 0x8b, 0x5d, BPF_RBX_OFF);
+					EMIT1(0xc9);		/* leaveq */
+				}
+				EMIT1(0xc3);		/* ret */
+				break;
+			case BPF_MISC|BPF_TAX: /* X = A */
+				seen |= SEEN_XREG;
+				EMIT2(0x89, 0xc3);	/* mov %eax,%ebx */
+				break;
+			case BPF_MISC|BPF_TXA: /* A = X */
+				seen |= SEEN_XREG;
+				EMIT2(0x89, 0xd8);	/* mov %ebx,%eax */
+				break;
+			case BPF_LD|BPF_IMM: /* A = K */
+				if (!K)
+					CLEAR_A();
+				else
+					EMIT1_off32(0xb8, K);	/* mov $imm32,%eax */
+				break;
+			case BPF_LDX|BPF_IMM: /* X = K */
+				seen |= SEEN_XREG;
+				if (!K)
+					CLEAR_X();
+				else
+					EMIT1_off32(0xbb, K);	/* mov $imm32,%ebx */
+				break;
+			case BPF_LD|BPF_MEM: /* A = mem[K] : mov off8(%rbp),%eax */
+				seen |= SEEN_MEM;
+				EMIT3(0x8b, 0x45, BPF_MEM_OFF + K * 4);
+				break;
+			case BPF_LDX|BPF_MEM: /* X = mem[K] : mov off8(%rbp),%ebx */
+				seen |= SEEN_XREG | SEEN_MEM;
+				EMIT3(0x8b, 0x5d, BPF_MEM_OFF + K * 4);
+				break;
+			case BPF_ST: /* mem[K] = A : mov %eax,off8(%rbp) */
+				seen |= SEEN_MEM;
+				EMIT3(0x89, 0x45, BPF_MEM_OFF + K * 4);
+				break;
+			case BPF_STX: /* mem[K] = X : mov %ebx,off8(%rbp) */
+				seen |= SEEN_XREG | SEEN_MEM;
+				EMIT3(0x89, 0x5d, BPF_MEM_OFF + K * 4);
+				break;
+			case BPF_LD|BPF_W|BPF_LEN: /* A = skb->len; */
+				BUILD_BUG_ON(FIELD_SIZEOF(struct sk_buff, len) != 4);
+				if (is_imm8(offsetof(struct sk_buff, len)))
+					/* mov off8(%rdi),%eax */
+					EMIT3(0x8b, 0x47, offsetof(struct sk_buff, len));
+				else {
+					EMIT2(0x8b, 0x87);	/* mov off32(%rdi),%eax */
+					EMIT(offsetof(struct sk_buff, len), 4);
+				}
+				break;
+			case BPF_LDX|BPF_W|BPF_LEN: /* X = skb->len; */
+				seen |= SEEN_XREG;
+				if (is_imm8(offsetof(struct sk_buff, len)))
+					/* mov off8(%rdi),%ebx */
+					EMIT3(0x8b, 0x5f, offsetof(struct sk_buff, len));
+				else {
+					EMIT2(0x8b, 0x9f);	/* mov off32(%rdi),%ebx */
+					EMIT(offsetof(struct sk_buff, len), 4);
+				}
+				break;
+			case BPF_LD|BPF_W|BPF_ABS:
+				func = bpf_jit_load_word;
+common_load:			if ((int)K < 0 && (int)K >= SKF_AD_OFF)
+					goto ancillary;
+				seen |= SEEN_DATAREF;
+				EMIT1_off32(0xbe, K);	/* mov $imm32,%esi */
+				goto load_linear;
+			case BPF_LD|BPF_H|BPF_ABS:
+				func = bpf_jit_load_half;
+				goto common_load;
+			case BPF_LD|BPF_B|BPF_ABS:
+				func = bpf_jit_load_byte;
+				goto common_load;
+			case BPF_LD|BPF_W|BPF_IND:
+				func = bpf_jit_load_word;
+common_load_ind:		seen |= SEEN_DATAREF | SEEN_XREG;
+				if (!K)
+					EMIT2(0x89, 0xde);	/* mov %ebx,%esi */
+				else if (is_imm8(K))
+					EMIT3(0x8d, 0x73, K);	/* lea imm8(%rbx),%esi */
+				else {
+					EMIT2(0x8d, 0xb3);	/* lea imm32(%rbx),%esi */
+					EMIT(K, 4);
+				}
+load_linear:
+				switch (BPF_SIZE(filter[i].code)) {
+				case BPF_W:
+					EMIT_HEADLEN_CHECK(4);
+					EMIT2(X86_JA, 6 + 2);	/* ja slow path */
+					/* mov (%r12,%rsi),%eax */
+					EMIT4(0x41, 0x8b, 0x04, 0x34);
+					EMIT2(0x0f, 0xc8);	/* bswap %eax */
+					break;
+				case BPF_H:
+					EMIT_HEADLEN_CHECK(2);
+					EMIT2(X86_JA, 9 + 2);	/* ja slow path */
+					/* movzwl (%r12,%rsi),%eax */
+					EMIT4(0x41, 0x0f, 0xb7, 0x04);
+					EMIT1(0x34);
+					/* rol $8,%ax */
+					EMIT4(0x66, 0xc1, 0xc0, 0x08);
+					break;
+				default:
+					EMIT_HEADLEN_CHECK(1);
+					EMIT2(X86_JA, 5 + 2);	/* ja slow path */
+					/* movzbl (%r12,%rsi),%eax */
+					EMIT4(0x41, 0x0f, 0xb6, 0x04);
+					EMIT1(0x34);
+				}
+				if (BPF_MODE(filter[i].code) == BPF_IND) {
+					/* ancillary offsets need A and X */
+					EMIT2(0xeb, 4 + LOAD_CALL_LEN);
+					EMIT2(0x89, 0xc2);	/* mov %eax,%edx */
+					EMIT2(0x89, 0xd9);	/* mov %ebx,%ecx */
+				} else
+					EMIT2(0xeb, LOAD_CALL_LEN);
+				EMIT_LOAD_CALL(func);
+				break;
+			case BPF_LD|BPF_H|BPF_IND:
+				func = bpf_jit_load_half;
+				goto common_load_ind;
+			case BPF_LD|BPF_B|BPF_IND:
+				func = bpf_jit_load_byte;
+				goto common_load_ind;
+			case BPF_LDX|BPF_B|BPF_MSH: /* X = 4 * (P[K] & 0xf) */
+				seen |= SEEN_DATAREF | SEEN_XREG;
+				EMIT1_off32(0xbe, K);		/* mov $imm32,%esi */
+				EMIT_HEADLEN_CHECK(1);
+				EMIT2(X86_JA, 11 + 2);		/* ja slow path */
+				/* movzbl (%r12,%rsi),%ebx */
+				EMIT4(0x41, 0x0f, 0xb6, 0x1c);
+				EMIT1(0x34);
+				EMIT3(0x83, 0xe3, 0x0f);	/* and $0xf,%ebx */
+				EMIT3(0xc1, 0xe3, 0x02);	/* shl $2,%ebx */
+				EMIT2(0xeb, 3 + LOAD_CALL_LEN + 5);
+				EMIT3(0x89, 0x45, BPF_A_OFF);	/* mov %eax,-20(%rbp) */
+				EMIT_LOAD_CALL(bpf_jit_load_byte_msh);
+				EMIT2(0x89, 0xc3);		/* mov %eax,%ebx */
+				EMIT3(0x8b, 0x45, BPF_A_OFF);	/* mov -20(%rbp),%eax */
+				break;
+			case BPF_JMP|BPF_JA:
+				if (K)
+					EMIT_JMP(addrs[i + K]);
+				break;
+			COND_SEL(BPF_JMP|BPF_JGT|BPF_K, X86_JA, X86_JBE);
+			COND_SEL(BPF_JMP|BPF_JGE|BPF_K, X86_JAE, X86_JB);
+			COND_SEL(BPF_JMP|BPF_JEQ|BPF_K, X86_JE, X86_JNE);
+			COND_SEL(BPF_JMP|BPF_JSET|BPF_K, X86_JNE, X86_JE);
+			COND_SEL(BPF_JMP|BPF_JGT|BPF_X, X86_JA, X86_JBE);
+			COND_SEL(BPF_JMP|BPF_JGE|BPF_X, X86_JAE, X86_JB);
+			COND_SEL(BPF_JMP|BPF_JEQ|BPF_X, X86_JE, X86_JNE);
+			COND_SEL(BPF_JMP|BPF_JSET|BPF_X, X86_JNE, X86_JE);
+
+cond_branch:			/* same targets, can avoid doing the test :) */
+				if (filter[i].jt == filter[i].jf) {
+					EMIT_JMP(addrs[i + filter[i].jt]);
+					break;
+				}
+
+				switch (filter[i].code) {
+				case BPF_JMP|BPF_JGT|BPF_X:
+				case BPF_JMP|BPF_JGE|BPF_X:
+				case BPF_JMP|BPF_JEQ|BPF_X:
+					seen |= SEEN_XREG;
+					EMIT2(0x39, 0xd8); /* cmp %ebx,%eax */
+					break;
+				case BPF_JMP|BPF_JSET|BPF_X:
+					seen |= SEEN_XREG;
+					EMIT2(0x85, 0xd8); /* test %ebx,%eax */
+					break;
+				case BPF_JMP|BPF_JEQ|BPF_K:
+					if (K == 0) {
+						EMIT2(0x85, 0xc0); /* test %eax,%eax */
+						break;
+					}
+					/* fallthrough */
+				case BPF_JMP|BPF_JGT|BPF_K:
+				case BPF_JMP|BPF_JGE|BPF_K:
+					if (K <= 127)
+						EMIT3(0x83, 0xf8, K); /* cmp imm8,%eax */
+					else
+						EMIT1_off32(0x3d, K); /* cmp imm32,%eax */
+					break;
+				case BPF_JMP|BPF_JSET|BPF_K:
+					if (K <= 0xFF)
+						EMIT2(0xa8, K); /* test imm8,%al */
+					else if (!(K & 0xFFFF00FF))
+						EMIT3(0xf6, 0xc4, K >> 8); /* test imm8,%ah */
+					else if (K <= 0xFFFF) {
+						EMIT2(0x66, 0xa9); /* test imm16,%ax */
+						EMIT(K, 2);
+					} else {
+						EMIT1_off32(0xa9, K); /* test imm32,%eax */
+					}
+					break;
+				}
+				if (filter[i].jt != 0) {
+					EMIT_COND_JMP(t_op, addrs[i + filter[i].jt]);
+					if (filter[i].jf)
+						EMIT_JMP(addrs[i + filter[i].jf]);
+					break;
+				}
+				EMIT_COND_JMP(f_op, addrs[i + filter[i].jf]);
+				break;
+ancillary:
+				/* see the ancillary switch in sk_run_filter() */
+				switch (K - SKF_AD_OFF) {
+				case SKF_AD_PROTOCOL: /* A = ntohs(skb->protocol); */
+					BUILD_BUG_ON(FIELD_SIZEOF(struct sk_buff, protocol) != 2);
+					if (is_imm8(offsetof(struct sk_buff, protocol))) {
+						/* movzwl off8(%rdi),%eax */
+						EMIT4(0x0f, 0xb7, 0x47, offsetof(struct sk_buff, protocol));
+					} else {
+						EMIT3(0x0f, 0xb7, 0x87); /* movzwl off32(%rdi),%eax */
+						EMIT(offsetof(struct sk_buff, protocol), 4);
+					}
+					EMIT2(0x86, 0xc4); /* ntohs() : xchg %al,%ah */
+					break;
+				case SKF_AD_IFINDEX: /* A = skb->dev->ifindex; */
+					if (is_imm8(offsetof(struct sk_buff, dev))) {
+						/* movq off8(%rdi),%rax */
+						EMIT4(0x48, 0x8b, 0x47, offsetof(struct sk_buff, dev));
+					} else {
+						EMIT3(0x48, 0x8b, 0x87); /* movq off32(%rdi),%rax */
+						EMIT(offsetof(struct sk_buff, dev), 4);
+					}
+					EMIT3(0x48, 0x85, 0xc0);	/* test %rax,%rax */
+					EMIT_COND_JMP(X86_JE, cleanup_addr);
+					BUILD_BUG_ON(FIELD_SIZEOF(struct net_device, ifindex) != 4);
+					EMIT2(0x8b, 0x80);	/* mov off32(%rax),%eax */
+					EMIT(offsetof(struct net_device, ifindex), 4);
+					break;
+				case SKF_AD_MARK: /* A = skb->mark; */
+					BUILD_BUG_ON(FIELD_SIZEOF(struct sk_buff, mark) != 4);
+					if (is_imm8(offsetof(struct sk_buff, mark))) {
+						/* mov off8(%rdi),%eax */
+						EMIT3(0x8b, 0x47, offsetof(struct sk_buff, mark));
+					} else {
+						EMIT2(0x8b, 0x87); /* mov off32(%rdi),%eax */
+						EMIT(offsetof(struct sk_buff, mark), 4);
+					}
+					break;
+				default:
+					/*
+					 * pkt_type and queue_mapping are
+					 * bitfields, the netlink lookups
+					 * need helpers : leave it to
+					 * sk_run_filter()
+					 */
+					goto out;
+				}
+				break;
+			default:
+				/* hmm, too complex filter, give up with jit compiler */
+				goto out;
+			}
+			ilen = prog - temp;
+			if (image) {
+				if (unlikely(proglen + ilen > oldproglen)) {
+					pr_err("bpf_jit_compile fatal error\n");
+					kfree(addrs);
+					module_free(NULL, image);
+					return;
+				}
+				memcpy(image + proglen, temp, ilen);
+			}
+			proglen += ilen;
+			addrs[i] = proglen;
+			prog = temp;
+		}
+		/* last bpf instruction is always a RET :
+		 * use it to give the cleanup instruction(s) addr
+		 */
+		cleanup_addr = proglen - 1; /* ret */
+		if (seen_or_pass0)
+			cleanup_addr -= 5; /* mov -8(%rbp),%rbx; leaveq */
+		if (seen_or_pass0 & SEEN_DATAREF)
+			cleanup_addr -= 8; /* mov -32(%rbp),%r12; mov -40(%rbp),%r13 */
+
+		if (image) {
+			WARN_ON(proglen != oldproglen);
+			break;
+		}
+		if (proglen == oldproglen) {
+			image = module_alloc(max_t(unsigned int,
+						   proglen,
+						   sizeof(struct work_struct)));
+			if (!image)
+				goto out;
+		}
+		oldproglen = proglen;
+	}
+	/*
+	 * proglen only converged on the last pass : the image was
+	 * allocated but never filled, leave this one to sk_run_filter()
+	 */
+	if (image && pass == 10) {
+		module_free(NULL, image);
+		image = NULL;
+	}
+	if (bpf_jit_enable > 1)
+		pr_err("flen=%d proglen=%u pass=%d image=%p\n",
+		       flen, proglen, pass, image);
+
+	if (image) {
+		if (bpf_jit_enable > 1)
+			print_hex_dump(KERN_ERR, "JIT code: ", DUMP_PREFIX_ADDRESS,
+				       16, 1, image, proglen, false);
+
+		flush_icache_range((unsigned long)image,
+				   (unsigned long)image + proglen);
+		fp->bpf_func = (void *)image;
+	}
+out:
+	kfree(addrs);
+	return;
+}
+
+static void jit_free_defer(struct work_struct *arg)
+{
+	module_free(NULL, arg);
+}
+
+/* run from softirq, we must use a work_struct to call
+ * module_free() from process context
+ */
+void bpf_jit_free(struct sk_filter *fp)
+{
+	if (fp->bpf_func != sk_run_filter) {
+		struct work_struct *work = (struct work_struct *)fp->bpf_func;
+
+		INIT_WORK(work, jit_free_defer);
+		schedule_work(work);
+	}
+}
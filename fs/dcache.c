@@ -38,7 +38,34 @@
 int sysctl_vfs_cache_pressure __read_mostly = 100;
 EXPORT_SYMBOL_GPL(sysctl_vfs_cache_pressure);
 
+/*
+ * Usage:
+ * dcache_hash_lock protects:
+ *   - the dcache hash table, s_anon lists
+ * dcache_lru_lock protects:
+ *   - the dcache lru lists and counters, including the private lists
+ *     dentries are moved to while being pruned
+ * d_lock protects:
+ *   - d_flags
+ *   - d_name
+ *   - d_count transitions from zero.  Transitions to zero happen
+ *     under d_lock too, except in the slow path of dput(), which drops
+ *     the count under dcache_lock and re-checks it under d_lock
+ * dcache_lock protects:
+ *   - the dentry tree: d_subdirs, d_child, d_alias, d_parent
+ *   - the slow paths of dput(), which unlink a dentry from the tree
+ *
+ * Ordering:
+ * dcache_lock
+ *   dentry->d_lock
+ *     dcache_lru_lock
+ *     dcache_hash_lock
+ *
+ * dcache_lru_lock and dcache_hash_lock never nest.
+ */
  __cacheline_aligned_in_smp DEFINE_SPINLOCK(dcache_lock);
+static __cacheline_aligned_in_smp DEFINE_SPINLOCK(dcache_hash_lock);
+static __cacheline_aligned_in_smp DEFINE_SPINLOCK(dcache_lru_lock);
 __cacheline_aligned_in_smp DEFINE_SEQLOCK(rename_lock);
 
 EXPORT_SYMBOL(dcache_lock);
@@ -123,37 +150,74 @@ static void dentry_iput(struct dentry * dentry)
 }
 
 /*
- * dentry_lru_(add|add_tail|del|del_init) must be called with dcache_lock held.
+ * Unused dentries on each node, summed over all superblocks, so that
+ * the shrinker can size its work to the node it is asked to reclaim
+ * from.  Protected by dcache_lru_lock.
  */
-static void dentry_lru_add(struct dentry *dentry)
+static long dentry_unused_node[MAX_NUMNODES];
+
+/*
+ * Each superblock keeps one LRU list per node, and a dentry goes on
+ * the list of the node its memory was allocated from.  A dentry still
+ * counts as unused while it sits on a private list being pruned: the
+ * counters only drop when it is finally taken off by
+ * __dentry_lru_del_init().
+ *
+ * dentry_lru_(add|del|del_init) take dcache_lru_lock themselves;
+ * the __ variants must be called with dcache_lru_lock held.
+ */
+static void __dentry_lru_account_add(struct dentry *dentry)
 {
-	list_add(&dentry->d_lru, &dentry->d_sb->s_dentry_lru);
-	dentry->d_sb->s_nr_dentry_unused++;
+	list_lru_account_add(&dentry->d_sb->s_dentry_lru, &dentry->d_lru);
+	dentry_unused_node[list_lru_item_nid(dentry)]++;
 	dentry_stat.nr_unused++;
 }
 
-static void dentry_lru_add_tail(struct dentry *dentry)
+static void __dentry_lru_account_del(struct dentry *dentry)
 {
-	list_add_tail(&dentry->d_lru, &dentry->d_sb->s_dentry_lru);
-	dentry->d_sb->s_nr_dentry_unused++;
-	dentry_stat.nr_unused++;
+	list_lru_account_del(&dentry->d_sb->s_dentry_lru, &dentry->d_lru);
+	dentry_unused_node[list_lru_item_nid(dentry)]--;
+	dentry_stat.nr_unused--;
+}
+
+static void dentry_lru_add(struct dentry *dentry)
+{
+	struct list_lru *lru = &dentry->d_sb->s_dentry_lru;
+
+	spin_lock(&dcache_lru_lock);
+	if (list_empty(&dentry->d_lru)) {
+		list_add(&dentry->d_lru,
+			 list_lru_list(lru, list_lru_item_nid(dentry)));
+		__dentry_lru_account_add(dentry);
+	}
+	spin_unlock(&dcache_lru_lock);
 }
 
 static void dentry_lru_del(struct dentry *dentry)
 {
 	if (!list_empty(&dentry->d_lru)) {
-		list_del(&dentry->d_lru);
-		dentry->d_sb->s_nr_dentry_unused--;
-		dentry_stat.nr_unused--;
+		spin_lock(&dcache_lru_lock);
+		if (!list_empty(&dentry->d_lru)) {
+			list_del(&dentry->d_lru);
+			__dentry_lru_account_del(dentry);
+		}
+		spin_unlock(&dcache_lru_lock);
 	}
 }
 
+static void __dentry_lru_del_init(struct dentry *dentry)
+{
+	list_del_init(&dentry->d_lru);
+	__dentry_lru_account_del(dentry);
+}
+
 static void dentry_lru_del_init(struct dentry *dentry)
 {
 	if (likely(!list_empty(&dentry->d_lru))) {
-		list_del_init(&dentry->d_lru);
-		dentry->d_sb->s_nr_dentry_unused--;
-		dentry_stat.nr_unused--;
+		spin_lock(&dcache_lru_lock);
+		if (likely(!list_empty(&dentry->d_lru)))
+			__dentry_lru_del_init(dentry);
+		spin_unlock(&dcache_lru_lock);
 	}
 }
 
@@ -220,6 +284,31 @@ void dput(struct dentry *dentry)
 repeat:
 	if (atomic_read(&dentry->d_count) == 1)
 		might_sleep();
+	if (!atomic_dec_and_lock(&dentry->d_count, &dentry->d_lock))
+		return;
+
+	/*
+	 * Fast path: a hashed dentry that the filesystem does not want
+	 * to veto just goes onto the LRU.  That needs neither dcache_lock
+	 * nor any change to the dentry tree.
+	 */
+	if (likely(!d_unhashed(dentry) &&
+		   !(dentry->d_op && dentry->d_op->d_delete))) {
+		if (list_empty(&dentry->d_lru)) {
+			dentry->d_flags |= DCACHE_REFERENCED;
+			dentry_lru_add(dentry);
+		}
+		spin_unlock(&dentry->d_lock);
+		return;
+	}
+
+	/*
+	 * The dentry may have to be unlinked from the tree, which needs
+	 * dcache_lock, and that nests outside d_lock.  Hand the reference
+	 * back and drop it again with the locks taken in the right order.
+	 */
+	atomic_inc(&dentry->d_count);
+	spin_unlock(&dentry->d_lock);
 	if (!atomic_dec_and_lock(&dentry->d_count, &dcache_lock))
 		return;
 
@@ -448,37 +537,99 @@ static void prune_one_dentry(struct dentry * dentry)
 	}
 }
 
+/*
+ * Free the dentries on a private list built by __shrink_dcache_sb() or
+ * select_parent(), skipping any that were got hold of again meanwhile.
+ */
+static void shrink_dentry_list(struct list_head *list)
+{
+	struct dentry *dentry;
+
+	spin_lock(&dcache_lock);
+	while (!list_empty(list)) {
+		spin_lock(&dcache_lru_lock);
+		if (list_empty(list)) {
+			spin_unlock(&dcache_lru_lock);
+			break;
+		}
+		dentry = list_entry(list->prev, struct dentry, d_lru);
+		__dentry_lru_del_init(dentry);
+		spin_unlock(&dcache_lru_lock);
+
+		spin_lock(&dentry->d_lock);
+		/*
+		 * We found an inuse dentry which was not removed from
+		 * the LRU because of laziness during lookup.  Do not free
+		 * it - just keep it off the LRU list.
+		 */
+		if (atomic_read(&dentry->d_count)) {
+			spin_unlock(&dentry->d_lock);
+			continue;
+		}
+		prune_one_dentry(dentry);
+		/* dentry->d_lock was dropped in prune_one_dentry() */
+		cond_resched_lock(&dcache_lock);
+	}
+	spin_unlock(&dcache_lock);
+}
+
+static int dentry_lru_empty(struct super_block *sb)
+{
+	int nid;
+
+	for_each_node(nid)
+		if (!list_empty(list_lru_list(&sb->s_dentry_lru, nid)))
+			return 0;
+	return 1;
+}
+
 /*
  * Shrink the dentry LRU on a given superblock.
  * @sb   : superblock to shrink dentry LRU.
+ * @nid  : node whose LRU list to shrink; ignored if count is NULL.
  * @count: If count is NULL, we prune all dentries on superblock.
  * @flags: If flags is non-zero, we need to do special processing based on
  * which flags are set. This means we don't need to maintain multiple
  * similar copies of this loop.
  */
-static void __shrink_dcache_sb(struct super_block *sb, int *count, int flags)
+static void __shrink_dcache_sb(struct super_block *sb, int nid, int *count,
+			       int flags)
 {
 	LIST_HEAD(referenced);
 	LIST_HEAD(tmp);
+	struct list_head *lru;
 	struct dentry *dentry;
 	int cnt = 0;
 
 	BUG_ON(!sb);
 	BUG_ON((flags & DCACHE_REFERENCED) && count == NULL);
-	spin_lock(&dcache_lock);
 	if (count != NULL)
-		/* called from prune_dcache() and shrink_dcache_parent() */
+		/* called from prune_dcache() */
 		cnt = *count;
+	lru = list_lru_list(&sb->s_dentry_lru, nid);
 restart:
-	if (count == NULL)
-		list_splice_init(&sb->s_dentry_lru, &tmp);
-	else {
-		while (!list_empty(&sb->s_dentry_lru)) {
-			dentry = list_entry(sb->s_dentry_lru.prev,
-					struct dentry, d_lru);
+	spin_lock(&dcache_lru_lock);
+	if (count == NULL) {
+		int n;
+
+		for_each_node(n)
+			list_splice_init(list_lru_list(&sb->s_dentry_lru, n),
+					 &tmp);
+	} else {
+		while (!list_empty(lru)) {
+			dentry = list_entry(lru->prev, struct dentry, d_lru);
 			BUG_ON(dentry->d_sb != sb);
 
-			spin_lock(&dentry->d_lock);
+			/*
+			 * d_lock nests outside dcache_lru_lock, so only
+			 * trylock it here and back off on contention.
+			 */
+			if (!spin_trylock(&dentry->d_lock)) {
+				spin_unlock(&dcache_lru_lock);
+				cpu_relax();
+				spin_lock(&dcache_lru_lock);
+				continue;
+			}
 			/*
 			 * If we are honouring the DCACHE_REFERENCED flag and
 			 * the dentry has this flag set, don't free it. Clear
@@ -496,55 +647,44 @@ restart:
 				if (!cnt)
 					break;
 			}
-			cond_resched_lock(&dcache_lock);
+			cond_resched_lock(&dcache_lru_lock);
 		}
 	}
-	while (!list_empty(&tmp)) {
-		dentry = list_entry(tmp.prev, struct dentry, d_lru);
-		dentry_lru_del_init(dentry);
-		spin_lock(&dentry->d_lock);
-		/*
-		 * We found an inuse dentry which was not removed from
-		 * the LRU because of laziness during lookup.  Do not free
-		 * it - just keep it off the LRU list.
-		 */
-		if (atomic_read(&dentry->d_count)) {
-			spin_unlock(&dentry->d_lock);
-			continue;
-		}
-		prune_one_dentry(dentry);
-		/* dentry->d_lock was dropped in prune_one_dentry() */
-		cond_resched_lock(&dcache_lock);
-	}
-	if (count == NULL && !list_empty(&sb->s_dentry_lru))
+	spin_unlock(&dcache_lru_lock);
+
+	shrink_dentry_list(&tmp);
+	if (count == NULL && !dentry_lru_empty(sb))
 		goto restart;
 	if (count != NULL)
 		*count = cnt;
-	if (!list_empty(&referenced))
-		list_splice(&referenced, &sb->s_dentry_lru);
-	spin_unlock(&dcache_lock);
+	if (!list_empty(&referenced)) {
+		spin_lock(&dcache_lru_lock);
+		list_splice(&referenced, lru);
+		spin_unlock(&dcache_lru_lock);
+	}
 }
 
 /**
  * prune_dcache - shrink the dcache
  * @count: number of entries to try to free
+ * @nid: node to free them from
  *
  * Shrink the dcache. This is done when we need more memory, or simply when we
  * need to unmount something (at which point we need to unuse all dentries).
+ * Only dentries allocated on @nid are looked at.
  *
  * This function may fail to free any resources if all the dentries are in use.
  */
-static void prune_dcache(int count)
+static void prune_dcache(int count, int nid)
 {
 	struct super_block *sb;
 	int w_count;
-	int unused = dentry_stat.nr_unused;
+	int unused = dentry_unused_node[nid];
 	int prune_ratio;
 	int pruned;
 
 	if (unused == 0 || count == 0)
 		return;
-	spin_lock(&dcache_lock);
 restart:
 	if (count >= unused)
 		prune_ratio = 1;
@@ -552,7 +692,7 @@ restart:
 		prune_ratio = unused / count;
 	spin_lock(&sb_lock);
 	list_for_each_entry(sb, &super_blocks, s_list) {
-		if (sb->s_nr_dentry_unused == 0)
+		if (list_lru_count_node(&sb->s_dentry_lru, nid) == 0)
 			continue;
 		sb->s_count++;
 		/* Now, we reclaim unused dentrins with fairness.
@@ -561,14 +701,13 @@ restart:
 		 * as follows, but the implementation is arranged to avoid
 		 * overflows:
 		 * number of dentries to scan on this sb =
-		 * count * (number of dentries on this sb /
-		 * number of dentries in the machine)
+		 * count * (number of dentries of this sb on the node /
+		 * number of dentries on the node)
 		 */
 		spin_unlock(&sb_lock);
+		w_count = list_lru_count_node(&sb->s_dentry_lru, nid);
 		if (prune_ratio != 1)
-			w_count = (sb->s_nr_dentry_unused / prune_ratio) + 1;
-		else
-			w_count = sb->s_nr_dentry_unused;
+			w_count = (w_count / prune_ratio) + 1;
 		pruned = w_count;
 		/*
 		 * We need to be sure this filesystem isn't being unmounted,
@@ -578,13 +717,10 @@ restart:
 		 * s_root isn't NULL.
 		 */
 		if (down_read_trylock(&sb->s_umount)) {
-			if ((sb->s_root != NULL) &&
-			    (!list_empty(&sb->s_dentry_lru))) {
-				spin_unlock(&dcache_lock);
-				__shrink_dcache_sb(sb, &w_count,
+			if ((sb->s_root != NULL) && (w_count != 0)) {
+				__shrink_dcache_sb(sb, nid, &w_count,
 						DCACHE_REFERENCED);
 				pruned -= w_count;
-				spin_lock(&dcache_lock);
 			}
 			up_read(&sb->s_umount);
 		}
@@ -600,7 +736,6 @@ restart:
 		}
 	}
 	spin_unlock(&sb_lock);
-	spin_unlock(&dcache_lock);
 }
 
 /**
@@ -613,7 +748,7 @@ restart:
  */
 void shrink_dcache_sb(struct super_block * sb)
 {
-	__shrink_dcache_sb(sb, NULL, 0);
+	__shrink_dcache_sb(sb, 0, NULL, 0);
 }
 EXPORT_SYMBOL(shrink_dcache_sb);
 
@@ -802,19 +937,19 @@ EXPORT_SYMBOL(have_submounts);
 
 /*
  * Search the dentry child list for the specified parent,
- * and move any unused dentries to the end of the unused
- * list for prune_dcache(). We descend to the next level
+ * and move any unused dentries to the dispose list for
+ * shrink_dentry_list(). We descend to the next level
  * whenever the d_subdirs list is non-empty and continue
  * searching.
  *
  * It returns zero iff there are no unused children,
  * otherwise  it returns the number of children moved to
- * the end of the unused list. This may not be the total
+ * the dispose list. This may not be the total
  * number of unused children, because select_parent can
  * drop the lock and return early due to latency
  * constraints.
  */
-static int select_parent(struct dentry * parent)
+static int select_parent(struct dentry *parent, struct list_head *dispose)
 {
 	struct dentry *this_parent = parent;
 	struct list_head *next;
@@ -829,15 +964,21 @@ resume:
 		struct dentry *dentry = list_entry(tmp, struct dentry, d_u.d_child);
 		next = tmp->next;
 
-		dentry_lru_del_init(dentry);
-		/* 
-		 * move only zero ref count dentries to the end 
-		 * of the unused list for prune_dcache
+		/*
+		 * move only zero ref count dentries to the dispose list,
+		 * whichever node's LRU they were on
 		 */
 		if (!atomic_read(&dentry->d_count)) {
-			dentry_lru_add_tail(dentry);
+			spin_lock(&dcache_lru_lock);
+			if (list_empty(&dentry->d_lru)) {
+				list_add_tail(&dentry->d_lru, dispose);
+				__dentry_lru_account_add(dentry);
+			} else
+				list_move_tail(&dentry->d_lru, dispose);
+			spin_unlock(&dcache_lru_lock);
 			found++;
-		}
+		} else
+			dentry_lru_del_init(dentry);
 
 		/*
 		 * We can return to the caller if we have found some (this
@@ -877,16 +1018,16 @@ out:
  
 void shrink_dcache_parent(struct dentry * parent)
 {
-	struct super_block *sb = parent->d_sb;
-	int found;
+	LIST_HEAD(dispose);
 
-	while ((found = select_parent(parent)) != 0)
-		__shrink_dcache_sb(sb, &found, 0);
+	while (select_parent(parent, &dispose) != 0)
+		shrink_dentry_list(&dispose);
 }
 EXPORT_SYMBOL(shrink_dcache_parent);
 
 /*
- * Scan `nr' dentries and return the number which remain.
+ * Scan `nr' dentries on node sc->nid and return the number which remain
+ * there.
  *
  * We need to avoid reentering the filesystem if the caller is performing a
  * GFP_NOFS allocation attempt.  One example deadlock is:
@@ -897,19 +1038,23 @@ EXPORT_SYMBOL(shrink_dcache_parent);
  *
  * In this case we return -1 to tell the caller that we baled.
  */
-static int shrink_dcache_memory(int nr, gfp_t gfp_mask)
+static int shrink_dcache_memory(struct shrinker *shrink,
+				struct shrink_control *sc)
 {
+	int nr = sc->nr_to_scan;
+
 	if (nr) {
-		if (!(gfp_mask & __GFP_FS))
+		if (!(sc->gfp_mask & __GFP_FS))
 			return -1;
-		prune_dcache(nr);
+		prune_dcache(nr, sc->nid);
 	}
-	return (dentry_stat.nr_unused / 100) * sysctl_vfs_cache_pressure;
+	return (dentry_unused_node[sc->nid] / 100) * sysctl_vfs_cache_pressure;
 }
 
 static struct shrinker dcache_shrinker = {
 	.shrink = shrink_dcache_memory,
 	.seeks = DEFAULT_SEEKS,
+	.flags = SHRINKER_NUMA_AWARE,
 };
 
 /**
@@ -1183,7 +1328,9 @@ struct dentry *d_obtain_alias(struct inode *inode)
 	tmp->d_flags |= DCACHE_DISCONNECTED;
 	tmp->d_flags &= ~DCACHE_UNHASHED;
 	list_add(&tmp->d_alias, &inode->i_dentry);
+	spin_lock(&dcache_hash_lock);
 	hlist_add_head(&tmp->d_hash, &inode->i_sb->s_anon);
+	spin_unlock(&dcache_hash_lock);
 	spin_unlock(&tmp->d_lock);
 
 	spin_unlock(&dcache_lock);
@@ -1432,6 +1579,50 @@ next:
  	return found;
 }
 
+/**
+ * __d_lookup_rcu - search for a dentry without taking a reference
+ * @parent: parent dentry
+ * @name: qstr of name we wish to find
+ *
+ * This is the variant of __d_lookup() used by the lockless path walk.
+ * The caller must hold rcu_read_lock() and must validate anything it
+ * derives from the result against rename_lock.  No reference is taken:
+ * the dentry is instead returned with its d_lock held, which keeps it
+ * hashed and keeps d_inode pinned until the caller drops the lock.
+ *
+ * Parents with their own ->d_compare() are not handled here; NULL is
+ * returned for them and the caller falls back to __d_lookup().
+ */
+struct dentry * __d_lookup_rcu(struct dentry * parent, struct qstr * name)
+{
+	unsigned int len = name->len;
+	unsigned int hash = name->hash;
+	const unsigned char *str = name->name;
+	struct hlist_head *head = d_hash(parent,hash);
+	struct hlist_node *node;
+	struct dentry *dentry;
+
+	if (parent->d_op && parent->d_op->d_compare)
+		return NULL;
+
+	hlist_for_each_entry_rcu(dentry, node, head, d_hash) {
+		struct qstr *qstr;
+
+		if (dentry->d_name.hash != hash)
+			continue;
+		if (dentry->d_parent != parent)
+			continue;
+
+		spin_lock(&dentry->d_lock);
+		qstr = &dentry->d_name;
+		if (dentry->d_parent == parent && !d_unhashed(dentry) &&
+		    qstr->len == len && !memcmp(qstr->name, str, len))
+			return dentry;
+		spin_unlock(&dentry->d_lock);
+	}
+	return NULL;
+}
+
 /**
  * d_hash_and_lookup - hash the qstr then search for a dentry
  * @dir: Directory to search in
@@ -1481,17 +1672,20 @@ int d_validate(struct dentry *dentry, struct dentry *dparent)
 		goto out;
 
 	spin_lock(&dcache_lock);
+	spin_lock(&dcache_hash_lock);
 	base = d_hash(dparent, dentry->d_name.hash);
 	hlist_for_each(lhp,base) { 
 		/* hlist_for_each_entry_rcu() not required for d_hash list
-		 * as it is parsed under dcache_lock
+		 * as it is parsed under dcache_hash_lock
 		 */
 		if (dentry == hlist_entry(lhp, struct dentry, d_hash)) {
+			spin_unlock(&dcache_hash_lock);
 			__dget_locked(dentry);
 			spin_unlock(&dcache_lock);
 			return 1;
 		}
 	}
+	spin_unlock(&dcache_hash_lock);
 	spin_unlock(&dcache_lock);
 out:
 	return 0;
@@ -1544,11 +1738,30 @@ void d_delete(struct dentry * dentry)
 }
 EXPORT_SYMBOL(d_delete);
 
+/**
+ * __d_drop - unhash a dentry
+ * @dentry: dentry to unhash
+ *
+ * The caller must hold @dentry->d_lock.  See d_drop().
+ */
+void __d_drop(struct dentry *dentry)
+{
+	if (!(dentry->d_flags & DCACHE_UNHASHED)) {
+		dentry->d_flags |= DCACHE_UNHASHED;
+		spin_lock(&dcache_hash_lock);
+		hlist_del_rcu(&dentry->d_hash);
+		spin_unlock(&dcache_hash_lock);
+	}
+}
+EXPORT_SYMBOL(__d_drop);
+
 static void __d_rehash(struct dentry * entry, struct hlist_head *list)
 {
 
  	entry->d_flags &= ~DCACHE_UNHASHED;
+	spin_lock(&dcache_hash_lock);
  	hlist_add_head_rcu(&entry->d_hash, list);
+	spin_unlock(&dcache_hash_lock);
 }
 
 static void _d_rehash(struct dentry * entry)
@@ -1668,7 +1881,9 @@ static void d_move_locked(struct dentry * dentry, struct dentry * target)
 	if (d_unhashed(dentry))
 		goto already_unhashed;
 
+	spin_lock(&dcache_hash_lock);
 	hlist_del_rcu(&dentry->d_hash);
+	spin_unlock(&dcache_hash_lock);
 
 already_unhashed:
 	list = d_hash(target->d_parent, target->d_name.hash);
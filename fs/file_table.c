@@ -32,8 +32,15 @@ struct files_stat_struct files_stat = {
 	.max_files = NR_FILE
 };
 
-/* public. Not pretty! */
-__cacheline_aligned_in_smp DEFINE_SPINLOCK(files_lock);
+/*
+ * Each super block keeps one open file list per cpu, and each cpu's lists
+ * are protected by that cpu's files_cpu_lock.  A file is added to the list
+ * of the cpu that opened it and remembers that cpu in f_sb_list_cpu, so
+ * open() and close() only touch a cpu-local cacheline in the common case.
+ * The rare walkers of sb->s_files (remount read-only) take each cpu's lock
+ * in turn.
+ */
+static DEFINE_PER_CPU(spinlock_t, files_cpu_lock);
 
 /* SLAB cache for file structures */
 static struct kmem_cache *filp_cachep __read_mostly;
@@ -258,7 +265,7 @@ void __fput(struct file *file)
 		cdev_put(inode->i_cdev);
 	fops_put(file->f_op);
 	put_pid(file->f_owner.pid);
-	file_kill(file);
+	file_sb_list_del(file);
 	if (file->f_mode & FMODE_WRITE)
 		drop_file_write_access(file);
 	file->f_path.dentry = NULL;
@@ -325,50 +332,86 @@ void put_filp(struct file *file)
 {
 	if (atomic_long_dec_and_test(&file->f_count)) {
 		security_file_free(file);
-		file_kill(file);
+		file_sb_list_del(file);
 		file_free(file);
 	}
 }
 
-void file_move(struct file *file, struct list_head *list)
+static inline struct list_head *sb_files_list(struct super_block *sb, int cpu)
 {
-	if (!list)
-		return;
-	file_list_lock();
-	list_move(&file->f_u.fu_list, list);
-	file_list_unlock();
+#ifdef CONFIG_SMP
+	return per_cpu_ptr(sb->s_files, cpu);
+#else
+	return &sb->s_files;
+#endif
+}
+
+/**
+ *	file_sb_list_add - add a file to the sb's file list
+ *	@file: file to add
+ *	@sb: sb to add it to
+ *
+ *	Use this function to associate a file with the superblock of the inode
+ *	it refers to.  The file goes on the list of the current cpu.
+ */
+void file_sb_list_add(struct file *file, struct super_block *sb)
+{
+	int cpu = get_cpu();
+
+	spin_lock(&per_cpu(files_cpu_lock, cpu));
+#ifdef CONFIG_SMP
+	file->f_sb_list_cpu = cpu;
+#endif
+	list_move(&file->f_u.fu_list, sb_files_list(sb, cpu));
+	spin_unlock(&per_cpu(files_cpu_lock, cpu));
+	put_cpu();
 }
 
-void file_kill(struct file *file)
+/**
+ *	file_sb_list_del - remove a file from the sb's file list
+ *	@file: file to remove
+ *
+ *	Use this function to remove a file from its superblock.
+ */
+void file_sb_list_del(struct file *file)
 {
 	if (!list_empty(&file->f_u.fu_list)) {
-		file_list_lock();
+		int cpu = 0;
+
+#ifdef CONFIG_SMP
+		cpu = file->f_sb_list_cpu;
+#endif
+		spin_lock(&per_cpu(files_cpu_lock, cpu));
 		list_del_init(&file->f_u.fu_list);
-		file_list_unlock();
+		spin_unlock(&per_cpu(files_cpu_lock, cpu));
 	}
 }
 
 int fs_may_remount_ro(struct super_block *sb)
 {
 	struct file *file;
+	int cpu;
 
 	/* Check that no files are currently opened for writing. */
-	file_list_lock();
-	list_for_each_entry(file, &sb->s_files, f_u.fu_list) {
-		struct inode *inode = file->f_path.dentry->d_inode;
-
-		/* File with pending delete? */
-		if (inode->i_nlink == 0)
-			goto too_bad;
-
-		/* Writeable file? */
-		if (S_ISREG(inode->i_mode) && (file->f_mode & FMODE_WRITE))
-			goto too_bad;
+	for_each_possible_cpu(cpu) {
+		spin_lock(&per_cpu(files_cpu_lock, cpu));
+		list_for_each_entry(file, sb_files_list(sb, cpu), f_u.fu_list) {
+			struct inode *inode = file->f_path.dentry->d_inode;
+
+			/* File with pending delete? */
+			if (inode->i_nlink == 0)
+				goto too_bad;
+
+			/* Writeable file? */
+			if (S_ISREG(inode->i_mode) &&
+			    (file->f_mode & FMODE_WRITE))
+				goto too_bad;
+		}
+		spin_unlock(&per_cpu(files_cpu_lock, cpu));
 	}
-	file_list_unlock();
 	return 1; /* Tis' cool bro. */
 too_bad:
-	file_list_unlock();
+	spin_unlock(&per_cpu(files_cpu_lock, cpu));
 	return 0;
 }
 
@@ -382,39 +425,43 @@ too_bad:
 void mark_files_ro(struct super_block *sb)
 {
 	struct file *f;
+	int cpu;
 
+	for_each_possible_cpu(cpu) {
 retry:
-	file_list_lock();
-	list_for_each_entry(f, &sb->s_files, f_u.fu_list) {
-		struct vfsmount *mnt;
-		if (!S_ISREG(f->f_path.dentry->d_inode->i_mode))
-		       continue;
-		if (!file_count(f))
-			continue;
-		if (!(f->f_mode & FMODE_WRITE))
-			continue;
-		spin_lock(&f->f_lock);
-		f->f_mode &= ~FMODE_WRITE;
-		spin_unlock(&f->f_lock);
-		if (file_check_writeable(f) != 0)
-			continue;
-		file_release_write(f);
-		mnt = mntget(f->f_path.mnt);
-		file_list_unlock();
-		/*
-		 * This can sleep, so we can't hold
-		 * the file_list_lock() spinlock.
-		 */
-		mnt_drop_write(mnt);
-		mntput(mnt);
-		goto retry;
+		spin_lock(&per_cpu(files_cpu_lock, cpu));
+		list_for_each_entry(f, sb_files_list(sb, cpu), f_u.fu_list) {
+			struct vfsmount *mnt;
+			if (!S_ISREG(f->f_path.dentry->d_inode->i_mode))
+			       continue;
+			if (!file_count(f))
+				continue;
+			if (!(f->f_mode & FMODE_WRITE))
+				continue;
+			spin_lock(&f->f_lock);
+			f->f_mode &= ~FMODE_WRITE;
+			spin_unlock(&f->f_lock);
+			if (file_check_writeable(f) != 0)
+				continue;
+			file_release_write(f);
+			mnt = mntget(f->f_path.mnt);
+			spin_unlock(&per_cpu(files_cpu_lock, cpu));
+			/*
+			 * This can sleep, so we can't hold
+			 * the files_cpu_lock spinlock.
+			 */
+			mnt_drop_write(mnt);
+			mntput(mnt);
+			goto retry;
+		}
+		spin_unlock(&per_cpu(files_cpu_lock, cpu));
 	}
-	file_list_unlock();
 }
 
 void __init files_init(unsigned long mempages)
 { 
 	int n; 
+	int cpu;
 
 	filp_cachep = kmem_cache_create("filp", sizeof(struct file), 0,
 			SLAB_HWCACHE_ALIGN | SLAB_PANIC, NULL);
@@ -429,5 +476,7 @@ void __init files_init(unsigned long mempages)
 	if (files_stat.max_files < NR_FILE)
 		files_stat.max_files = NR_FILE;
 	files_defer_init();
+	for_each_possible_cpu(cpu)
+		spin_lock_init(&per_cpu(files_cpu_lock, cpu));
 	percpu_counter_init(&nr_files, 0);
 } 
@@ -307,7 +307,7 @@ void destroy_meta_inode(struct inode *inode)
 	}
 }
 
-/* called with inode_lock held */
+/* called with inode->i_lock held */
 static void logfs_drop_inode(struct inode *inode)
 {
 	struct logfs_super *super = logfs_super(inode->i_sb);
@@ -482,6 +482,35 @@ ok:
 	return security_inode_permission(inode, MAY_EXEC);
 }
 
+/*
+ * exec_permission() for the lockless walk.  It is called with a d_lock
+ * held, so it can neither sleep nor call into ACL or security code that
+ * might.  Anything the mode bits cannot decide on their own returns
+ * -EAGAIN and is left to exec_permission() in the refcounted walk.
+ */
+static int exec_permission_rcu(struct inode *inode)
+{
+	umode_t mode = inode->i_mode;
+
+	if (inode->i_op->permission)
+		return -EAGAIN;
+
+	if (current_fsuid() == inode->i_uid)
+		mode >>= 6;
+	else {
+		if (IS_POSIXACL(inode) && (mode & S_IRWXG) &&
+		    inode->i_op->check_acl)
+			return -EAGAIN;
+		if (in_group_p(inode->i_gid))
+			mode >>= 3;
+	}
+
+	if (!(mode & MAY_EXEC))
+		return -EAGAIN;
+
+	return security_inode_permission_rcu(inode, MAY_EXEC);
+}
+
 static __always_inline void set_root(struct nameidata *nd)
 {
 	if (!nd->root.mnt) {
@@ -792,6 +821,113 @@ fail:
 	return PTR_ERR(dentry);
 }
 
+/*
+ * Lockless walk of the leading components of a pathname.
+ *
+ * Directories that are already in the dcache are walked under
+ * rcu_read_lock() without touching their reference counts; each dentry
+ * is only pinned by its d_lock while it is looked at.  The walk stops in
+ * front of anything it cannot handle by itself - the final component,
+ * "." and "..", mount points, symlinks, dentries that need ->d_hash()
+ * or ->d_revalidate(), and directories whose permissions it cannot
+ * decide - and takes a reference on the dentry it stopped at.  If a
+ * rename raced with the walk, everything is thrown away and the
+ * refcounted walk starts again from the beginning.
+ *
+ * Returns the part of @name that is left to walk; nd->path.dentry has
+ * been advanced to match.  nd->path.mnt never changes here.
+ */
+static const char *link_path_walk_rcu(const char *name, struct nameidata *nd)
+{
+	struct dentry *start = nd->path.dentry;
+	struct dentry *dentry = start;
+	const char *rest = name;
+	unsigned seq;
+
+	seq = read_seqbegin(&rename_lock);
+	rcu_read_lock();
+	spin_lock(&dentry->d_lock);
+	for (;;) {
+		struct inode *inode = dentry->d_inode;
+		struct dentry *child;
+		unsigned long hash;
+		struct qstr this;
+		const char *p;
+		unsigned int c;
+
+		if (!inode || exec_permission_rcu(inode))
+			break;
+		if (dentry->d_op && dentry->d_op->d_hash)
+			break;
+
+		this.name = p = rest;
+		c = *(const unsigned char *)p;
+
+		hash = init_name_hash();
+		do {
+			p++;
+			hash = partial_name_hash(c, hash);
+			c = *(const unsigned char *)p;
+		} while (c && (c != '/'));
+		this.len = p - (const char *) this.name;
+		this.hash = end_name_hash(hash);
+
+		/* the last component is left to the refcounted walk */
+		if (!c)
+			break;
+		while (*++p == '/');
+		if (!*p)
+			break;
+
+		if (this.name[0] == '.' &&
+		    (this.len == 1 || (this.len == 2 && this.name[1] == '.')))
+			break;
+
+		spin_unlock(&dentry->d_lock);
+		child = __d_lookup_rcu(dentry, &this);
+		if (child) {
+			inode = child->d_inode;
+			if (inode && inode->i_op->lookup &&
+			    !inode->i_op->follow_link &&
+			    !d_mountpoint(child) &&
+			    !(child->d_op && child->d_op->d_revalidate)) {
+				/* child->d_lock is held, carry on from it */
+				if (!(child->d_flags & DCACHE_REFERENCED))
+					child->d_flags |= DCACHE_REFERENCED;
+				dentry = child;
+				rest = p;
+				continue;
+			}
+			spin_unlock(&child->d_lock);
+		}
+		spin_lock(&dentry->d_lock);
+		break;
+	}
+
+	/*
+	 * dentry->d_lock is held.  A dentry that is still hashed cannot be
+	 * in the middle of being killed, so it is safe to take a reference
+	 * even if its count has dropped to zero.
+	 */
+	if (dentry == start || d_unhashed(dentry)) {
+		spin_unlock(&dentry->d_lock);
+		rcu_read_unlock();
+		return name;
+	}
+	atomic_inc(&dentry->d_count);
+	spin_unlock(&dentry->d_lock);
+	rcu_read_unlock();
+
+	if (read_seqretry(&rename_lock, seq)) {
+		dput(dentry);
+		return name;
+	}
+
+	dput(start);
+	nd->path.dentry = dentry;
+	return rest;
+}
+
 /*
  * This is a temporary kludge to deal with "automount" symlinks; proper
  * solution is to trigger them on follow_mount(), so that do_lookup()
@@ -823,6 +959,9 @@ static int link_path_walk(const char *name, struct nameidata *nd)
 	if (!*name)
 		goto return_reval;
 
+	if (!(nd->flags & LOOKUP_REVAL))
+		name = link_path_walk_rcu(name, nd);
+
 	inode = nd->path.dentry->d_inode;
 	if (nd->depth)
 		lookup_flags = LOOKUP_FOLLOW | (nd->flags & LOOKUP_CONTINUE);
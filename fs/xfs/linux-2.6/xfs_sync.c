@@ -879,9 +879,11 @@ static struct rw_semaphore xfs_mount_list_lock;
 
 static int
 xfs_reclaim_inode_shrink(
-	int		nr_to_scan,
-	gfp_t		gfp_mask)
+	struct shrinker		*shrink,
+	struct shrink_control	*sc)
 {
+	int		nr_to_scan = sc->nr_to_scan;
+	gfp_t		gfp_mask = sc->gfp_mask;
 	struct xfs_mount *mp;
 	struct xfs_perag *pag;
 	xfs_agnumber_t	ag;
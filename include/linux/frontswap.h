@@ -0,0 +1,151 @@
+#ifndef _LINUX_FRONTSWAP_H
+#define _LINUX_FRONTSWAP_H
+
+#include <linux/swap.h>
+#include <linux/mm.h>
+#include <linux/bitops.h>
+
+/*
+ * frontswap: a hook in front of the swap devices
+ *
+ * A backend registered here is offered every page on its way to swap,
+ * and may keep a copy of it (compressed, say) keyed by swap type and
+ * offset.  Pages it accepts are never written to the swap device, and
+ * are read back from the backend instead.
+ *
+ * The operations are called in different contexts:
+ *
+ *   store		from swap_writepage() with the page locked, often on
+ *			behalf of reclaim: it may sleep, but allocations
+ *			must not start I/O (GFP_NOIO)
+ *   load		from swap_readpage() with the page locked: it may
+ *			sleep
+ *   invalidate_page	from swap_entry_free() under swap_lock, and after
+ *			a failed store over an old copy: it must not sleep
+ *   init,
+ *   invalidate_area	from swapon and swapoff under swap_lock (and
+ *			swapon_mutex): they must not sleep
+ */
+struct frontswap_ops {
+	void (*init)(unsigned type);
+	int (*store)(unsigned type, pgoff_t offset, struct page *page);
+	int (*load)(unsigned type, pgoff_t offset, struct page *page);
+	void (*invalidate_page)(unsigned type, pgoff_t offset);
+	void (*invalidate_area)(unsigned type);
+};
+
+#ifdef CONFIG_FRONTSWAP
+
+extern int frontswap_enabled;
+
+extern struct frontswap_ops
+	frontswap_register_ops(struct frontswap_ops *ops);
+
+extern void __frontswap_init(unsigned type);
+extern int __frontswap_store(struct page *page);
+extern int __frontswap_load(struct page *page);
+extern void __frontswap_invalidate_page(unsigned type, pgoff_t offset);
+extern void __frontswap_invalidate_area(unsigned type);
+
+static inline int frontswap_test(struct swap_info_struct *sis, pgoff_t offset)
+{
+	if (frontswap_enabled && sis->frontswap_map)
+		return test_bit(offset, sis->frontswap_map);
+	return 0;
+}
+
+static inline unsigned long *frontswap_map_get(struct swap_info_struct *p)
+{
+	return p->frontswap_map;
+}
+
+static inline void frontswap_map_set(struct swap_info_struct *p,
+				     unsigned long *map)
+{
+	p->frontswap_map = map;
+	atomic_set(&p->frontswap_pages, 0);
+}
+
+static inline void frontswap_init(unsigned type)
+{
+	if (frontswap_enabled)
+		__frontswap_init(type);
+}
+
+/*
+ * Returns 0 if the backend took the page, so that the caller must not
+ * write it to the swap device.
+ */
+static inline int frontswap_store(struct page *page)
+{
+	if (frontswap_enabled)
+		return __frontswap_store(page);
+	return -1;
+}
+
+/*
+ * Returns 0 if the page was filled in from the backend.
+ */
+static inline int frontswap_load(struct page *page)
+{
+	if (frontswap_enabled)
+		return __frontswap_load(page);
+	return -1;
+}
+
+static inline void frontswap_invalidate_page(unsigned type, pgoff_t offset)
+{
+	if (frontswap_enabled)
+		__frontswap_invalidate_page(type, offset);
+}
+
+static inline void frontswap_invalidate_area(unsigned type)
+{
+	if (frontswap_enabled)
+		__frontswap_invalidate_area(type);
+}
+
+#else /* CONFIG_FRONTSWAP */
+
+#define frontswap_enabled	(0)
+
+static inline int frontswap_test(struct swap_info_struct *sis, pgoff_t offset)
+{
+	return 0;
+}
+
+static inline unsigned long *frontswap_map_get(struct swap_info_struct *p)
+{
+	return NULL;
+}
+
+static inline void frontswap_map_set(struct swap_info_struct *p,
+				     unsigned long *map)
+{
+}
+
+static inline void frontswap_init(unsigned type)
+{
+}
+
+static inline int frontswap_store(struct page *page)
+{
+	return -1;
+}
+
+static inline int frontswap_load(struct page *page)
+{
+	return -1;
+}
+
+static inline void frontswap_invalidate_page(unsigned type, pgoff_t offset)
+{
+}
+
+static inline void frontswap_invalidate_area(unsigned type)
+{
+}
+
+#endif /* CONFIG_FRONTSWAP */
+
+#endif /* _LINUX_FRONTSWAP_H */
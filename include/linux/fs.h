@@ -374,6 +374,7 @@ struct inodes_stat_t {
 #include <linux/cache.h>
 #include <linux/kobject.h>
 #include <linux/list.h>
+#include <linux/list_lru.h>
 #include <linux/radix-tree.h>
 #include <linux/prio_tree.h>
 #include <linux/init.h>
@@ -731,7 +732,8 @@ struct posix_acl;
 
 struct inode {
 	struct hlist_node	i_hash;
-	struct list_head	i_list;		/* backing dev IO list */
+	struct list_head	i_wb_list;	/* backing dev IO list */
+	struct list_head	i_lru;		/* inode LRU list */
 	struct list_head	i_sb_list;
 	struct list_head	i_dentry;  //指向引用索引节点的dentry对象链表的头部
 	unsigned long		i_ino;   //索引节点号
@@ -752,7 +754,7 @@ struct inode {
 	blkcnt_t		i_blocks;   //文件的块数
 	unsigned short          i_bytes;  //文件最后一块的字节数
 	umode_t			i_mode;
-	spinlock_t		i_lock;	/* i_blocks, i_bytes, maybe i_size */
+	spinlock_t		i_lock;	/* i_state, i_blocks, i_bytes, maybe i_size */
 	struct mutex		i_mutex;
 	struct rw_semaphore	i_alloc_sem;
 	const struct inode_operations	*i_op;  //inode的操作
@@ -927,6 +929,9 @@ struct file {
 		struct list_head	fu_list;  //文件对象组成的链表
 		struct rcu_head 	fu_rcuhead;
 	} f_u;
+#ifdef CONFIG_SMP
+	int			f_sb_list_cpu;	/* which s_files list we are on */
+#endif
 	struct path		f_path;
 #define f_dentry	f_path.dentry  //与file相关的目录项对象
 #define f_vfsmnt	f_path.mnt     //含有该文件的已安装文件系统
@@ -956,10 +961,6 @@ struct file {
 	unsigned long f_mnt_write_state;
 #endif
 };
-extern spinlock_t files_lock;
-#define file_list_lock() spin_lock(&files_lock);
-#define file_list_unlock() spin_unlock(&files_lock);
-
 #define get_file(x)	atomic_long_inc(&(x)->f_count)
 #define file_count(x)	atomic_long_read(&(x)->f_count)
 
@@ -1349,12 +1350,16 @@ struct super_block {
 #endif
 	struct xattr_handler	**s_xattr;
 
+	spinlock_t		s_inode_list_lock;	/* protects s_inodes */
 	struct list_head	s_inodes;	/* all inodes 所有索引节点的链表*/
 	struct hlist_head	s_anon;		/* anonymous dentries for (nfs) exporting */
+#ifdef CONFIG_SMP
+	struct list_head __percpu *s_files;	/* per-cpu open file lists */
+#else
 	struct list_head	s_files;   /* 文件对象的链表 */
-	/* s_dentry_lru and s_nr_dentry_unused are protected by dcache_lock */
-	struct list_head	s_dentry_lru;	/* unused dentry lru */
-	int			s_nr_dentry_unused;	/* # of dentry on lru */
+#endif
+	/* s_dentry_lru is protected by dcache_lru_lock */
+	struct list_lru		s_dentry_lru;	/* unused dentry lru, per node */
 
 	struct block_device	*s_bdev;
 	struct backing_dev_info *s_bdi;
@@ -1591,7 +1596,7 @@ struct super_operations {
 };
 
 /*
- * Inode state bits.  Protected by inode_lock.
+ * Inode state bits.  Protected by inode->i_lock.
  *
  * Three bits determine the dirty state of the inode, I_DIRTY_SYNC,
  * I_DIRTY_DATASYNC and I_DIRTY_PAGES.
@@ -1636,6 +1641,10 @@ struct super_operations {
  *			set during data writeback, and cleared with a wakeup
  *			on the bit address once it is done.
  *
+ * I_REFERENCED		Inode was put on the unused list since the last pass
+ *			of prune_icache() over it.  It gets one more trip
+ *			around the list before it is reclaimed.
+ *
  * Q: What is the difference between I_WILL_FREE and I_FREEING?
  */
 #define I_DIRTY_SYNC		1
@@ -1648,6 +1657,7 @@ struct super_operations {
 #define I_CLEAR			64
 #define __I_SYNC		7
 #define I_SYNC			(1 << __I_SYNC)
+#define I_REFERENCED		256
 
 #define I_DIRTY (I_DIRTY_SYNC | I_DIRTY_DATASYNC | I_DIRTY_PAGES)
 
@@ -2155,6 +2165,7 @@ extern void inode_init_once(struct inode *);
 extern void inode_add_to_lists(struct super_block *, struct inode *);
 extern void iput(struct inode *);
 extern struct inode * igrab(struct inode *);
+extern void ihold(struct inode * inode);
 extern ino_t iunique(struct super_block *, ino_t);
 extern int inode_needs_sync(struct inode *inode);
 extern void generic_delete_inode(struct inode *inode);
@@ -2189,8 +2200,8 @@ static inline void insert_inode_hash(struct inode *inode) {
 	__insert_inode_hash(inode, inode->i_ino);
 }
 
-extern void file_move(struct file *f, struct list_head *list);
-extern void file_kill(struct file *f);
+extern void file_sb_list_add(struct file *f, struct super_block *sb);
+extern void file_sb_list_del(struct file *f);
 #ifdef CONFIG_BLOCK
 struct bio;
 extern void submit_bio(int, struct bio *);
@@ -2469,6 +2480,8 @@ ssize_t simple_attr_write(struct file *file, const char __user *buf,
 struct ctl_table;
 int proc_nr_files(struct ctl_table *table, int write,
 		  void __user *buffer, size_t *lenp, loff_t *ppos);
+int proc_nr_inodes(struct ctl_table *table, int write,
+		   void __user *buffer, size_t *lenp, loff_t *ppos);
 
 int __init get_filesystem_list(char *buf);
 
@@ -0,0 +1,49 @@
+#ifndef _LINUX_LIST_LRU_H
+#define _LINUX_LIST_LRU_H
+
+/*
+ * An LRU list split per NUMA node, so that reclaim driven by a shortage
+ * on one node only has to look at the objects allocated on that node.
+ * An object goes on the list of the node its memory comes from.
+ *
+ * The caller provides the locking: all of these, and any direct use of
+ * the per-node lists, must be serialised by the lock protecting the LRU.
+ */
+#include <linux/list.h>
+#include <linux/types.h>
+
+struct list_lru_node {
+	struct list_head	list;
+	long			nr_items;
+};
+
+struct list_lru {
+	struct list_lru_node	*node;
+	long			nr_items;	/* total, all nodes */
+};
+
+extern int list_lru_init(struct list_lru *lru);
+extern void list_lru_destroy(struct list_lru *lru);
+
+extern int list_lru_item_nid(void *item);
+extern void list_lru_account_add(struct list_lru *lru, struct list_head *item);
+extern void list_lru_account_del(struct list_lru *lru, struct list_head *item);
+extern bool list_lru_add(struct list_lru *lru, struct list_head *item);
+extern bool list_lru_del(struct list_lru *lru, struct list_head *item);
+
+static inline struct list_head *list_lru_list(struct list_lru *lru, int nid)
+{
+	return &lru->node[nid].list;
+}
+
+static inline long list_lru_count_node(struct list_lru *lru, int nid)
+{
+	return lru->node[nid].nr_items;
+}
+
+static inline long list_lru_count(struct list_lru *lru)
+{
+	return lru->nr_items;
+}
+
+#endif /* _LINUX_LIST_LRU_H */
@@ -114,6 +114,7 @@ enum zone_stat_item {
 	NR_ISOLATED_ANON,	/* Temporary isolated pages from anon lru */
 	NR_ISOLATED_FILE,	/* Temporary isolated pages from file lru */
 	NR_SHMEM,		/* shmem pages (included tmpfs/GEM pages) */
+	NR_ANON_TRANSPARENT_HUGEPAGES,
 #ifdef CONFIG_NUMA
 	NUMA_HIT,		/* allocated in intended node */
 	NUMA_MISS,		/* allocated in non intended node */
@@ -165,6 +166,15 @@ static inline int is_unevictable_lru(enum lru_list l)
 	return (l == LRU_UNEVICTABLE);
 }
 
+/*
+ * A set of LRU lists.  Every page on the LRU is on exactly one lruvec:
+ * that of the memory cgroup it is charged to, or the zone's own when
+ * the memory controller is not in use.
+ */
+struct lruvec {
+	struct list_head lists[NR_LRU_LISTS];
+};
+
 enum zone_watermarks {
 	WMARK_MIN,
 	WMARK_LOW,
@@ -337,7 +347,8 @@ struct zone {
 #endif
 	/*
 		用于伙伴系统，free_area代表着伙伴系统的数组，有MAX_ORDER个对象。
-	MAX_ORDER == 11：代表11个链表（分别是页框个数为1、2、4...1024的空闲块链表）
+	
+MAX_ORDER == 11：代表11个链表（分别是页框个数为1、2、4...1024的空闲块链表）
 	*/
 	struct free_area	free_area[MAX_ORDER];
 
@@ -349,14 +360,21 @@ struct zone {
 	unsigned long		*pageblock_flags; //zone中page的位图区域
 #endif /* CONFIG_SPARSEMEM */
 
+#ifdef CONFIG_COMPACTION
+	/*
+	 * On compaction failure, 1<<compact_defer_shift compactions
+	 * are skipped before trying again. The number attempted since
+	 * last failure is tracked with compact_considered.
+	 */
+	unsigned int		compact_considered;
+	unsigned int		compact_defer_shift;
+#endif
 
 	ZONE_PADDING(_pad1_)
 
 	/* Fields commonly accessed by the page reclaim scanner */
 	spinlock_t		lru_lock;	
-	struct zone_lru {
-		struct list_head list;
-	} lru[NR_LRU_LISTS];
+	struct lruvec		lruvec;
 
 	struct zone_reclaim_stat reclaim_stat;
 
@@ -26,8 +26,14 @@
  */
 struct anon_vma {
 	spinlock_t lock;	/* Serialize access to vma list */
-#ifdef CONFIG_KSM
-	atomic_t ksm_refcount;
+#if defined(CONFIG_KSM) || defined(CONFIG_MIGRATION)
+	/*
+	 * The external_refcount is taken by either KSM or page migration
+	 * to pin an anon_vma when there is no guarantee that its vmas
+	 * will stay around for the duration of the operation.  Whoever
+	 * drops the last reference frees the anon_vma if it is empty.
+	 */
+	atomic_t external_refcount;
 #endif
 	/*
 	 * NOTE: the LSB of the head.next is set by
@@ -61,26 +67,41 @@ struct anon_vma_chain {
 };
 
 #ifdef CONFIG_MMU
-#ifdef CONFIG_KSM
-static inline void ksm_refcount_init(struct anon_vma *anon_vma)
+#if defined(CONFIG_KSM) || defined(CONFIG_MIGRATION)
+static inline void anonvma_external_refcount_init(struct anon_vma *anon_vma)
+{
+	atomic_set(&anon_vma->external_refcount, 0);
+}
+
+static inline int anonvma_external_refcount(struct anon_vma *anon_vma)
 {
-	atomic_set(&anon_vma->ksm_refcount, 0);
+	return atomic_read(&anon_vma->external_refcount);
 }
 
-static inline int ksm_refcount(struct anon_vma *anon_vma)
+static inline void get_anon_vma(struct anon_vma *anon_vma)
 {
-	return atomic_read(&anon_vma->ksm_refcount);
+	atomic_inc(&anon_vma->external_refcount);
 }
+
+void drop_anon_vma(struct anon_vma *anon_vma);
 #else
-static inline void ksm_refcount_init(struct anon_vma *anon_vma)
+static inline void anonvma_external_refcount_init(struct anon_vma *anon_vma)
 {
 }
 
-static inline int ksm_refcount(struct anon_vma *anon_vma)
+static inline int anonvma_external_refcount(struct anon_vma *anon_vma)
 {
 	return 0;
 }
-#endif /* CONFIG_KSM */
+
+static inline void get_anon_vma(struct anon_vma *anon_vma)
+{
+}
+
+static inline void drop_anon_vma(struct anon_vma *anon_vma)
+{
+}
+#endif /* CONFIG_KSM || CONFIG_MIGRATION */
 
 static inline struct anon_vma *page_anon_vma(struct page *page)
 {
@@ -171,6 +192,11 @@ pte_t *page_check_address(struct page *, struct mm_struct *,
  */
 unsigned long page_address_in_vma(struct page *, struct vm_area_struct *);
 
+/*
+ * Used by split_huge_page to find the huge pmds mapping an anon page.
+ */
+unsigned long vma_address(struct page *, struct vm_area_struct *);
+
 /*
  * Cleans the PTEs of shared mappings.
  * (and since clean PTEs should also be readonly, write protects them too)
@@ -22,6 +22,14 @@ struct rw_semaphore;
 #include <asm/rwsem.h> /* use an arch-specific implementation */
 #endif
 
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+/*
+ * ->owner is the writer holding the semaphore, NULL if there is none,
+ * or this if readers hold it (or were the last to take it).
+ */
+#define RWSEM_READER_OWNED	((struct thread_info *)1UL)
+#endif
+
 /*
  * lock for reading
  */
@@ -7,6 +7,7 @@
 #define _LINUX_TICK_H
 
 #include <linux/clockchips.h>
+#include <linux/cpumask.h>
 
 #ifdef CONFIG_GENERIC_CLOCKEVENTS
 
@@ -44,6 +45,9 @@ enum tick_nohz_mode {
  * @idle_sleeptime:	Sum of the time slept in idle with sched tick stopped
  * @sleep_length:	Duration of the current idle sleep
  * @do_timer_lst:	CPU was the last one doing do_timer before going idle
+ * @full_stopped:	Tick stopped while running a single task (NO_HZ_FULL)
+ * @full_user:		The task was in user mode when the tick was stopped
+ * @full_jiffies:	jiffies up to which the running task has been accounted
  */
 struct tick_sched {
 	struct hrtimer			sched_timer;
@@ -66,6 +70,11 @@ struct tick_sched {
 	unsigned long			next_jiffies;
 	ktime_t				idle_expires;
 	int				do_timer_last;
+#ifdef CONFIG_NO_HZ_FULL
+	int				full_stopped;
+	int				full_user;
+	unsigned long			full_jiffies;
+#endif
 };
 
 extern void __init tick_init(void);
@@ -136,4 +145,36 @@ static inline ktime_t tick_nohz_get_sleep_length(void)
 static inline u64 get_cpu_idle_time_us(int cpu, u64 *unused) { return -1; }
 # endif /* !NO_HZ */
 
+# ifdef CONFIG_NO_HZ_FULL
+extern cpumask_var_t tick_nohz_full_mask;
+extern bool tick_nohz_full_running;
+
+static inline int tick_nohz_full_cpu(int cpu)
+{
+	return tick_nohz_full_running &&
+	       cpumask_test_cpu(cpu, tick_nohz_full_mask);
+}
+
+extern int __tick_nohz_full_stopped(int cpu);
+extern void __tick_nohz_full_restart_tick(void);
+extern void tick_nohz_full_check(void);
+
+static inline int tick_nohz_full_stopped(int cpu)
+{
+	return tick_nohz_full_running && __tick_nohz_full_stopped(cpu);
+}
+
+/* Called on entry to schedule(): the task mix may be about to change. */
+static inline void tick_nohz_full_restart_tick(void)
+{
+	if (tick_nohz_full_running)
+		__tick_nohz_full_restart_tick();
+}
+# else
+static inline int tick_nohz_full_cpu(int cpu) { return 0; }
+static inline int tick_nohz_full_stopped(int cpu) { return 0; }
+static inline void tick_nohz_full_check(void) { }
+static inline void tick_nohz_full_restart_tick(void) { }
+# endif /* !NO_HZ_FULL */
+
 #endif
@@ -0,0 +1,149 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM writeback
+
+#if !defined(_TRACE_WRITEBACK_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_WRITEBACK_H
+
+#include <linux/tracepoint.h>
+#include <linux/backing-dev.h>
+#include <linux/device.h>
+
+#define KBps(x)			((x) << (PAGE_SHIFT - 10))
+
+#define bdi_trace_name(bdi)	((bdi)->dev ? dev_name((bdi)->dev) : "(none)")
+
+/**
+ * bdi_dirty_ratelimit - the per-bdi throttle rate was re-estimated
+ * @bdi:		the backing device
+ * @dirty_rate:		measured rate at which pages were dirtied
+ * @task_ratelimit:	rate dirtiers were throttled at during the interval
+ * @balanced_dirty_ratelimit: rate that would balance dirtying and writeout
+ */
+TRACE_EVENT(bdi_dirty_ratelimit,
+
+	TP_PROTO(struct backing_dev_info *bdi,
+		 unsigned long dirty_rate,
+		 unsigned long task_ratelimit,
+		 unsigned long balanced_dirty_ratelimit),
+
+	TP_ARGS(bdi, dirty_rate, task_ratelimit, balanced_dirty_ratelimit),
+
+	TP_STRUCT__entry(
+		__array(char,		bdi, 32)
+		__field(unsigned long,	write_bw)
+		__field(unsigned long,	avg_write_bw)
+		__field(unsigned long,	dirty_rate)
+		__field(unsigned long,	dirty_ratelimit)
+		__field(unsigned long,	task_ratelimit)
+		__field(unsigned long,	balanced_dirty_ratelimit)
+	),
+
+	TP_fast_assign(
+		strlcpy(__entry->bdi, bdi_trace_name(bdi), 32);
+		__entry->write_bw	= KBps(bdi->write_bandwidth);
+		__entry->avg_write_bw	= KBps(bdi->avg_write_bandwidth);
+		__entry->dirty_rate	= KBps(dirty_rate);
+		__entry->dirty_ratelimit = KBps(bdi->dirty_ratelimit);
+		__entry->task_ratelimit	= KBps(task_ratelimit);
+		__entry->balanced_dirty_ratelimit =
+					  KBps(balanced_dirty_ratelimit);
+	),
+
+	TP_printk("bdi %s: "
+		  "write_bw=%lu awrite_bw=%lu dirty_rate=%lu "
+		  "dirty_ratelimit=%lu task_ratelimit=%lu "
+		  "balanced_dirty_ratelimit=%lu",
+		  __entry->bdi,
+		  __entry->write_bw,		/* write bandwidth */
+		  __entry->avg_write_bw,	/* avg write bandwidth */
+		  __entry->dirty_rate,		/* bdi dirty rate */
+		  __entry->dirty_ratelimit,	/* base ratelimit */
+		  __entry->task_ratelimit, /* ratelimit with position control */
+		  __entry->balanced_dirty_ratelimit /* the balanced ratelimit */
+	)
+);
+
+/**
+ * balance_dirty_pages - a dirtier was throttled
+ * @bdi:		the backing device
+ * @thresh:		global dirty limit
+ * @bg_thresh:		global background writeback threshold
+ * @dirty:		global dirty + writeback + unstable pages
+ * @bdi_thresh:		this bdi's share of the dirty limit
+ * @bdi_dirty:		this bdi's dirty + writeback pages
+ * @dirty_ratelimit:	the bdi's base throttle rate
+ * @task_ratelimit:	the throttle rate after position control
+ * @dirtied:		pages the task dirtied since it was last throttled
+ * @pause:		jiffies the task is going to sleep
+ * @start_time:		jiffies when the task entered balance_dirty_pages
+ */
+TRACE_EVENT(balance_dirty_pages,
+
+	TP_PROTO(struct backing_dev_info *bdi,
+		 unsigned long thresh,
+		 unsigned long bg_thresh,
+		 unsigned long dirty,
+		 unsigned long bdi_thresh,
+		 unsigned long bdi_dirty,
+		 unsigned long dirty_ratelimit,
+		 unsigned long task_ratelimit,
+		 unsigned long dirtied,
+		 long pause,
+		 unsigned long start_time),
+
+	TP_ARGS(bdi, thresh, bg_thresh, dirty, bdi_thresh, bdi_dirty,
+		dirty_ratelimit, task_ratelimit,
+		dirtied, pause, start_time),
+
+	TP_STRUCT__entry(
+		__array(	 char,	bdi, 32)
+		__field(unsigned long,	limit)
+		__field(unsigned long,	bg_limit)
+		__field(unsigned long,	dirty)
+		__field(unsigned long,	bdi_limit)
+		__field(unsigned long,	bdi_dirty)
+		__field(unsigned long,	dirty_ratelimit)
+		__field(unsigned long,	task_ratelimit)
+		__field(unsigned int,	dirtied)
+		__field(	 long,	pause)
+		__field(unsigned long,	paused)
+	),
+
+	TP_fast_assign(
+		strlcpy(__entry->bdi, bdi_trace_name(bdi), 32);
+
+		__entry->limit		= thresh;
+		__entry->bg_limit	= bg_thresh;
+		__entry->dirty		= dirty;
+		__entry->bdi_limit	= bdi_thresh;
+		__entry->bdi_dirty	= bdi_dirty;
+		__entry->dirty_ratelimit = KBps(dirty_ratelimit);
+		__entry->task_ratelimit	= KBps(task_ratelimit);
+		__entry->dirtied	= dirtied;
+		__entry->pause		= pause * 1000 / HZ;
+		__entry->paused		= (jiffies - start_time) * 1000 / HZ;
+	),
+
+	TP_printk("bdi %s: "
+		  "limit=%lu bg_limit=%lu dirty=%lu "
+		  "bdi_limit=%lu bdi_dirty=%lu "
+		  "dirty_ratelimit=%lu task_ratelimit=%lu "
+		  "dirtied=%u pause=%ld paused=%lu",
+		  __entry->bdi,
+		  __entry->limit,
+		  __entry->bg_limit,
+		  __entry->dirty,
+		  __entry->bdi_limit,
+		  __entry->bdi_dirty,
+		  __entry->dirty_ratelimit,
+		  __entry->task_ratelimit,
+		  __entry->dirtied,
+		  __entry->pause,	/* ms */
+		  __entry->paused	/* ms */
+	)
+);
+
+#endif /* _TRACE_WRITEBACK_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
@@ -1393,6 +1393,19 @@ static inline int fastpath_timer_check(struct task_struct *tsk)
 	return sig->rlim[RLIMIT_CPU].rlim_cur != RLIM_INFINITY;
 }
 
+#ifdef CONFIG_NO_HZ_FULL
+/*
+ * Does @tsk (current) have armed CPU-time timers, which are only
+ * checked from the tick?  RLIMIT_CPU has one second granularity and
+ * is served by the residual tick of an adaptive-tick CPU.
+ */
+int posix_cpu_timers_need_tick(struct task_struct *tsk)
+{
+	return !task_cputime_zero(&tsk->cputime_expires) ||
+	       !task_cputime_zero(&tsk->signal->cputime_expires);
+}
+#endif
+
 /*
  * This is called from the timer interrupt handler.  The irq handler has
  * already updated our counts.  We need to check if any timers fire now.
@@ -46,6 +46,8 @@
 #include <linux/cpu.h>
 #include <linux/mutex.h>
 #include <linux/time.h>
+#include <linux/kthread.h>
+#include <linux/tick.h>
 
 #include "rcutree.h"
 
@@ -181,11 +183,13 @@ cpu_has_callbacks_ready_to_invoke(struct rcu_data *rdp)
 
 /*
  * Does the current CPU require a yet-as-unscheduled grace period?
+ * Offloaded callbacks waiting in an rcuo kthread count on every CPU.
  */
 static int
 cpu_needs_another_gp(struct rcu_state *rsp, struct rcu_data *rdp)
 {
-	return *rdp->nxttail[RCU_DONE_TAIL] && !rcu_gp_in_progress(rsp);
+	return (*rdp->nxttail[RCU_DONE_TAIL] || rcu_nocb_needs_gp(rsp)) &&
+	       !rcu_gp_in_progress(rsp);
 }
 
 /*
@@ -220,8 +224,11 @@ static int rcu_implicit_offline_qs(struct rcu_data *rdp)
 		return 1;
 	}
 
-	/* If preemptable RCU, no point in sending reschedule IPI. */
-	if (rdp->preemptable)
+	/*
+	 * If preemptable RCU, no point in sending reschedule IPI, unless
+	 * the CPU might be running with its tick stopped.
+	 */
+	if (rdp->preemptable && !tick_nohz_full_cpu(rdp->cpu))
 		return 0;
 
 	/* The CPU is online, so send it a reschedule IPI. */
@@ -1316,6 +1323,9 @@ __rcu_process_callbacks(struct rcu_state *rsp, struct rcu_data *rdp)
 
 	/* If there are callbacks ready, invoke them. */
 	rcu_do_batch(rsp, rdp);
+
+	/* Let rcuo kthreads invoke callbacks whose grace period ended. */
+	rcu_nocb_gp_wake(rsp);
 }
 
 /*
@@ -1366,6 +1376,13 @@ __call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
 	 */
 	local_irq_save(flags);
 	rdp = rsp->rda[smp_processor_id()];
+
+	/* Offloaded CPUs hand the callback to their rcuo kthread. */
+	if (rcu_nocb_queue(rdp, head)) {
+		local_irq_restore(flags);
+		return;
+	}
+
 	rcu_process_gp_end(rsp, rdp);
 	check_for_new_grace_period(rsp, rdp);
 
@@ -1534,6 +1551,12 @@ static int __rcu_pending(struct rcu_state *rsp, struct rcu_data *rdp)
 		return 1;
 	}
 
+	/* Are rcuo kthreads waiting on a grace period that has ended? */
+	if (rcu_nocb_gp_wake_pending(rsp)) {
+		rdp->n_rp_gp_completed++;
+		return 1;
+	}
+
 	/* nothing to do */
 	rdp->n_rp_need_nothing++;
 	return 0;
@@ -1560,10 +1583,30 @@ static int rcu_needs_cpu_quick_check(int cpu)
 {
 	/* RCU callbacks either ready or pending? */
 	return per_cpu(rcu_sched_data, cpu).nxtlist ||
+	       per_cpu(rcu_bh_data, cpu).nxtlist ||
+	       rcu_preempt_needs_cpu(cpu) ||
+	       rcu_nocb_needs_cpu();
+}
+
+#ifdef CONFIG_NO_HZ_FULL
+
+/*
+ * Does RCU need the scheduling-clock tick on an adaptive-tick CPU that
+ * is running a task, either for this CPU's own callbacks or because a
+ * grace period is waiting on it?  A grace period that starts while the
+ * tick is stopped reaches the CPU through force_quiescent_state()'s
+ * reschedule IPI, whose irq_exit() then restarts the tick.
+ */
+int rcu_cpu_needs_tick(int cpu)
+{
+	return rcu_pending(cpu) ||
+	       per_cpu(rcu_sched_data, cpu).nxtlist ||
 	       per_cpu(rcu_bh_data, cpu).nxtlist ||
 	       rcu_preempt_needs_cpu(cpu);
 }
 
+#endif /* #ifdef CONFIG_NO_HZ_FULL */
+
 static DEFINE_PER_CPU(struct rcu_head, rcu_barrier_head) = {NULL};
 static atomic_t rcu_barrier_cpu_count;
 static DEFINE_MUTEX(rcu_barrier_mutex);
@@ -1615,6 +1658,7 @@ static void _rcu_barrier(struct rcu_state *rsp,
 	preempt_disable(); /* stop CPU_DYING from filling orphan_cbs_list */
 	rcu_adopt_orphan_cbs(rsp);
 	on_each_cpu(rcu_barrier_func, (void *)call_rcu_func, 1);
+	rcu_nocb_barrier(rsp);
 	preempt_enable(); /* CPU_DYING can again fill orphan_cbs_list */
 	if (atomic_dec_and_test(&rcu_barrier_cpu_count))
 		complete(&rcu_barrier_completion);
@@ -1662,6 +1706,7 @@ rcu_boot_init_percpu_data(int cpu, struct rcu_state *rsp)
 	rdp->dynticks = &per_cpu(rcu_dynticks, cpu);
 #endif /* #ifdef CONFIG_NO_HZ */
 	rdp->cpu = cpu;
+	rcu_boot_init_nocb_percpu_data(rdp, rsp);
 	raw_spin_unlock_irqrestore(&rnp->lock, flags);
 }
 
@@ -1849,6 +1894,8 @@ static void __init rcu_init_one(struct rcu_state *rsp)
 			INIT_LIST_HEAD(&rnp->blocked_tasks[3]);
 		}
 	}
+
+	rcu_init_nocb_state(rsp);
 }
 
 /*
@@ -27,6 +27,7 @@
 #include <linux/threads.h>
 #include <linux/cpumask.h>
 #include <linux/seqlock.h>
+#include <linux/wait.h>
 
 /*
  * Define shape of hierarchy based on NR_CPUS and CONFIG_RCU_FANOUT.
@@ -230,6 +231,17 @@ struct rcu_data {
 	unsigned long n_rp_need_fqs;
 	unsigned long n_rp_need_nothing;
 
+#ifdef CONFIG_RCU_NOCB_CPU
+	/* 6) callback offloading to the rcuo kthread. */
+	struct rcu_head *nocb_head;	/* Callbacks handed to the kthread. */
+	struct rcu_head **nocb_tail;
+	atomic_long_t nocb_q_count;	/* # callbacks queued or in flight. */
+	wait_queue_head_t nocb_wq;	/* For the kthread to sleep on. */
+	struct task_struct *nocb_kthread;
+					/* Non-NULL once offloading is on. */
+	struct rcu_state *nocb_rsp;	/* Flavor this kthread serves. */
+#endif /* #ifdef CONFIG_RCU_NOCB_CPU */
+
 	int cpu;
 };
 
@@ -326,6 +338,15 @@ struct rcu_state {
 	unsigned long jiffies_stall;		/* Time at which to check */
 						/*  for CPU stalls. */
 #endif /* #ifdef CONFIG_RCU_CPU_STALL_DETECTOR */
+#ifdef CONFIG_RCU_NOCB_CPU
+	unsigned long nocb_gp_target;		/* ->completed value that the */
+						/*  rcuo kthreads wait for. */
+						/*  Guarded by root's lock. */
+	unsigned long nocb_gp_woken;		/* ->completed value at last */
+						/*  rcuo kthread wakeup. */
+	wait_queue_head_t nocb_gp_wq;		/* rcuo kthreads waiting for */
+						/*  a grace period. */
+#endif /* #ifdef CONFIG_RCU_NOCB_CPU */
 };
 
 /* Return values for rcu_preempt_offline_tasks(). */
@@ -383,5 +404,14 @@ static void __cpuinit rcu_preempt_init_percpu_data(int cpu);
 static void rcu_preempt_send_cbs_to_orphanage(void);
 static void __init __rcu_init_preempt(void);
 static void rcu_needs_cpu_flush(void);
+static int rcu_nocb_queue(struct rcu_data *rdp, struct rcu_head *rhp);
+static int rcu_nocb_needs_gp(struct rcu_state *rsp);
+static int rcu_nocb_gp_wake_pending(struct rcu_state *rsp);
+static void rcu_nocb_gp_wake(struct rcu_state *rsp);
+static int rcu_nocb_needs_cpu(void);
+static void rcu_nocb_barrier(struct rcu_state *rsp);
+static void __init rcu_init_nocb_state(struct rcu_state *rsp);
+static void __init rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp,
+						  struct rcu_state *rsp);
 
 #endif /* #ifndef RCU_TREE_NONCORE */
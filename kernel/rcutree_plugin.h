@@ -1047,7 +1047,7 @@ int rcu_needs_cpu(int cpu)
 	/* If RCU callbacks are still pending, RCU still needs this CPU. */
 	if (c)
 		raise_softirq(RCU_SOFTIRQ);
-	return c;
+	return c || rcu_nocb_needs_cpu();
 }
 
 /*
@@ -1067,3 +1067,344 @@ static void rcu_needs_cpu_flush(void)
 }
 
 #endif /* #else #if !defined(CONFIG_RCU_FAST_NO_HZ) */
+
+#ifdef CONFIG_RCU_NOCB_CPU
+
+/*
+ * Offload of RCU callback invocation from the CPUs listed in the
+ * rcu_nocbs= boot parameter.  call_rcu() and friends on such a CPU
+ * append the callback to a lockless per-CPU list and wake that CPU's
+ * rcuo kthread, which waits for a full grace period of the flavor and
+ * then invokes the callbacks.  The kthread is not bound to the CPU it
+ * serves, so it can be confined to housekeeping CPUs.
+ *
+ * The offloaded CPUs still take part in grace-period detection exactly
+ * as before; only callback invocation moves.  Their ->nxtlist is empty
+ * apart from callbacks queued during early boot, so they neither raise
+ * RCU_SOFTIRQ for callbacks nor hold off dyntick-idle mode.
+ */
+
+static cpumask_var_t rcu_nocb_mask;
+static bool have_rcu_nocb_mask;
+
+static int __init rcu_nocb_setup(char *str)
+{
+	alloc_bootmem_cpumask_var(&rcu_nocb_mask);
+	have_rcu_nocb_mask = true;
+	cpulist_parse(str, rcu_nocb_mask);
+	return 1;
+}
+__setup("rcu_nocbs=", rcu_nocb_setup);
+
+/*
+ * Hand the callback to the rcuo kthread if the CPU owning @rdp is
+ * offloaded, returning 1 if so.  May be invoked from any context,
+ * including for a CPU other than the current one.
+ */
+static int rcu_nocb_queue(struct rcu_data *rdp, struct rcu_head *rhp)
+{
+	struct rcu_head **old_tail;
+	struct task_struct *t = ACCESS_ONCE(rdp->nocb_kthread);
+
+	if (!t)
+		return 0;
+	atomic_long_inc(&rdp->nocb_q_count);
+	old_tail = xchg(&rdp->nocb_tail, &rhp->next);
+	ACCESS_ONCE(*old_tail) = rhp;
+
+	/* If the list was empty, the kthread might be sleeping. */
+	if (old_tail == &rdp->nocb_head)
+		wake_up(&rdp->nocb_wq);
+	return 1;
+}
+
+/*
+ * Does an rcuo kthread need a grace period that has not yet started?
+ */
+static int rcu_nocb_needs_gp(struct rcu_state *rsp)
+{
+	return ULONG_CMP_LT(ACCESS_ONCE(rsp->completed),
+			    ACCESS_ONCE(rsp->nocb_gp_target));
+}
+
+/*
+ * Are there rcuo kthreads that have not yet been woken for the
+ * grace period they are waiting on?
+ */
+static int rcu_nocb_gp_waiting(struct rcu_state *rsp)
+{
+	return ULONG_CMP_LT(ACCESS_ONCE(rsp->nocb_gp_woken),
+			    ACCESS_ONCE(rsp->nocb_gp_target));
+}
+
+/*
+ * Has a grace period ended since rcuo kthreads were last woken while
+ * some of them are still waiting?
+ */
+static int rcu_nocb_gp_wake_pending(struct rcu_state *rsp)
+{
+	return rcu_nocb_gp_waiting(rsp) &&
+	       ACCESS_ONCE(rsp->nocb_gp_woken) != ACCESS_ONCE(rsp->completed);
+}
+
+/*
+ * Wake up rcuo kthreads waiting for a grace period if one has ended
+ * since the last wakeup.  Called from RCU_SOFTIRQ rather than from the
+ * grace-period machinery itself, which can run under scheduler locks.
+ */
+static void rcu_nocb_gp_wake(struct rcu_state *rsp)
+{
+	unsigned long c = ACCESS_ONCE(rsp->completed);
+	unsigned long w = ACCESS_ONCE(rsp->nocb_gp_woken);
+
+	if (!rcu_nocb_gp_waiting(rsp) || w == c)
+		return;
+	if (cmpxchg(&rsp->nocb_gp_woken, w, c) == w)
+		wake_up_all(&rsp->nocb_gp_wq);
+}
+
+/*
+ * Keep the scheduling-clock tick going while rcuo kthreads wait for a
+ * grace period, as nothing else may be pushing it forward.
+ */
+static int rcu_nocb_needs_cpu(void)
+{
+	return rcu_nocb_gp_waiting(&rcu_sched_state) ||
+#ifdef CONFIG_TREE_PREEMPT_RCU
+	       rcu_nocb_gp_waiting(&rcu_preempt_state) ||
+#endif /* #ifdef CONFIG_TREE_PREEMPT_RCU */
+	       rcu_nocb_gp_waiting(&rcu_bh_state);
+}
+
+/*
+ * rcu_barrier() reaches online CPUs through on_each_cpu(), but an
+ * offloaded CPU that has since gone offline may still have callbacks
+ * in its rcuo kthread.  Queue the barrier callback behind them.  The
+ * caller must have preemption disabled to exclude CPU hotplug.
+ */
+static void rcu_nocb_barrier(struct rcu_state *rsp)
+{
+	int cpu;
+	struct rcu_data *rdp;
+	struct rcu_head *head;
+
+	if (!have_rcu_nocb_mask)
+		return;
+	for_each_cpu(cpu, rcu_nocb_mask) {
+		rdp = rsp->rda[cpu];
+		if (cpu_online(cpu) || !rdp->nocb_kthread ||
+		    !atomic_long_read(&rdp->nocb_q_count))
+			continue;
+		head = &per_cpu(rcu_barrier_head, cpu);
+		head->func = rcu_barrier_callback;
+		head->next = NULL;
+		atomic_inc(&rcu_barrier_cpu_count);
+		rcu_nocb_queue(rdp, head);
+	}
+}
+
+/*
+ * Wait for a grace period that starts after the callbacks currently
+ * held by the rcuo kthread were queued, starting one if needed.
+ */
+static void rcu_nocb_wait_gp(struct rcu_state *rsp)
+{
+	unsigned long c;
+	unsigned long flags;
+	struct rcu_node *rnp = rcu_get_root(rsp);
+
+	raw_spin_lock_irqsave(&rnp->lock, flags);
+	c = rsp->gpnum + 1;
+	if (ULONG_CMP_LT(rsp->nocb_gp_target, c))
+		rsp->nocb_gp_target = c;
+	rcu_start_gp(rsp, flags);  /* releases rnp->lock. */
+
+	for (;;) {
+		wait_event_interruptible(rsp->nocb_gp_wq,
+			ULONG_CMP_GE(ACCESS_ONCE(rsp->completed), c));
+		if (ULONG_CMP_GE(ACCESS_ONCE(rsp->completed), c))
+			break;
+		flush_signals(current);
+	}
+	smp_mb(); /* Grace period ends before callbacks are invoked. */
+}
+
+/*
+ * Per-CPU, per-flavor kthread invoking the offloaded callbacks.
+ */
+static int rcu_nocb_kthread(void *arg)
+{
+	long count;
+	struct rcu_head *list;
+	struct rcu_head *next;
+	struct rcu_head **tail;
+	struct rcu_data *rdp = arg;
+
+	for (;;) {
+		wait_event_interruptible(rdp->nocb_wq,
+					 ACCESS_ONCE(rdp->nocb_head));
+		list = ACCESS_ONCE(rdp->nocb_head);
+		if (!list) {
+			flush_signals(current);
+			continue;
+		}
+
+		/* Take the whole list, new arrivals start a new one. */
+		ACCESS_ONCE(rdp->nocb_head) = NULL;
+		tail = xchg(&rdp->nocb_tail, &rdp->nocb_head);
+
+		rcu_nocb_wait_gp(rdp->nocb_rsp);
+
+		count = 0;
+		while (list) {
+			next = list->next;
+			/* Wait for enqueuers that lost the race to link. */
+			while (next == NULL && &list->next != tail) {
+				schedule_timeout_interruptible(1);
+				next = ACCESS_ONCE(list->next);
+			}
+			local_bh_disable();
+			list->func(list);
+			local_bh_enable();
+			list = next;
+			count++;
+			cond_resched();
+		}
+		atomic_long_sub(count, &rdp->nocb_q_count);
+	}
+	return 0;
+}
+
+static void __init rcu_init_nocb_state(struct rcu_state *rsp)
+{
+	rsp->nocb_gp_target = rsp->completed;
+	rsp->nocb_gp_woken = rsp->completed;
+	init_waitqueue_head(&rsp->nocb_gp_wq);
+}
+
+static void __init rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp,
+						  struct rcu_state *rsp)
+{
+	rdp->nocb_head = NULL;
+	rdp->nocb_tail = &rdp->nocb_head;
+	atomic_long_set(&rdp->nocb_q_count, 0);
+	init_waitqueue_head(&rdp->nocb_wq);
+	rdp->nocb_rsp = rsp;
+}
+
+/*
+ * Create the rcuo kthreads of one flavor for all offloaded CPUs.  They
+ * start out affine to the CPUs that are not offloaded, if any.
+ */
+static void __init rcu_spawn_nocb_kthreads_one(struct rcu_state *rsp,
+					       char flavor,
+					       const struct cpumask *hk)
+{
+	int cpu;
+	struct rcu_data *rdp;
+	struct task_struct *t;
+
+	for_each_cpu(cpu, rcu_nocb_mask) {
+		rdp = rsp->rda[cpu];
+		t = kthread_create(rcu_nocb_kthread, rdp,
+				   "rcuo%c/%d", flavor, cpu);
+		if (IS_ERR(t)) {
+			printk(KERN_ERR "rcu: can't offload callbacks of "
+			       "CPU %d\n", cpu);
+			continue;
+		}
+		if (hk)
+			set_cpus_allowed_ptr(t, hk);
+		wake_up_process(t);
+		smp_mb(); /* Initialization before first rcu_nocb_queue(). */
+		ACCESS_ONCE(rdp->nocb_kthread) = t;
+	}
+}
+
+static int __init rcu_spawn_nocb_kthreads(void)
+{
+	cpumask_var_t hk;
+	bool have_hk;
+	char buf[64];
+
+#ifdef CONFIG_NO_HZ_FULL
+	/* CPUs running with their tick stopped must not invoke callbacks. */
+	if (tick_nohz_full_running) {
+		if (!have_rcu_nocb_mask) {
+			if (!zalloc_cpumask_var(&rcu_nocb_mask, GFP_KERNEL))
+				return 0;
+			have_rcu_nocb_mask = true;
+		}
+		cpumask_or(rcu_nocb_mask, rcu_nocb_mask, tick_nohz_full_mask);
+	}
+#endif /* #ifdef CONFIG_NO_HZ_FULL */
+	if (!have_rcu_nocb_mask)
+		return 0;
+	cpumask_and(rcu_nocb_mask, rcu_nocb_mask, cpu_possible_mask);
+	if (cpumask_empty(rcu_nocb_mask))
+		return 0;
+	cpulist_scnprintf(buf, sizeof(buf), rcu_nocb_mask);
+	printk(KERN_INFO "RCU callbacks offloaded from CPUs %s.\n", buf);
+
+	have_hk = zalloc_cpumask_var(&hk, GFP_KERNEL);
+	if (have_hk) {
+		cpumask_andnot(hk, cpu_possible_mask, rcu_nocb_mask);
+		if (cpumask_empty(hk)) {
+			free_cpumask_var(hk);
+			have_hk = false;
+		}
+	}
+
+	rcu_spawn_nocb_kthreads_one(&rcu_sched_state, 's', have_hk ? hk : NULL);
+	rcu_spawn_nocb_kthreads_one(&rcu_bh_state, 'b', have_hk ? hk : NULL);
+#ifdef CONFIG_TREE_PREEMPT_RCU
+	rcu_spawn_nocb_kthreads_one(&rcu_preempt_state, 'p',
+				    have_hk ? hk : NULL);
+#endif /* #ifdef CONFIG_TREE_PREEMPT_RCU */
+
+	if (have_hk)
+		free_cpumask_var(hk);
+	return 0;
+}
+early_initcall(rcu_spawn_nocb_kthreads);
+
+#else /* #ifdef CONFIG_RCU_NOCB_CPU */
+
+static int rcu_nocb_queue(struct rcu_data *rdp, struct rcu_head *rhp)
+{
+	return 0;
+}
+
+static int rcu_nocb_needs_gp(struct rcu_state *rsp)
+{
+	return 0;
+}
+
+static int rcu_nocb_gp_wake_pending(struct rcu_state *rsp)
+{
+	return 0;
+}
+
+static void rcu_nocb_gp_wake(struct rcu_state *rsp)
+{
+}
+
+static int rcu_nocb_needs_cpu(void)
+{
+	return 0;
+}
+
+static void rcu_nocb_barrier(struct rcu_state *rsp)
+{
+}
+
+static void __init rcu_init_nocb_state(struct rcu_state *rsp)
+{
+}
+
+static void __init rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp,
+						  struct rcu_state *rsp)
+{
+}
+
+#endif /* #else #ifdef CONFIG_RCU_NOCB_CPU */
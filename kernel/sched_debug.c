@@ -151,6 +151,9 @@ static void print_rq(struct seq_file *m, struct rq *rq, int rq_cpu)
 	(defined(CONFIG_FAIR_GROUP_SCHED) || defined(CONFIG_RT_GROUP_SCHED))
 static void task_group_path(struct task_group *tg, char *buf, int buflen)
 {
+	if (autogroup_path(tg, buf, buflen))
+		return;
+
 	/* may be NULL if the underlying cgroup isn't fully-created yet */
 	if (!tg->css.cgroup) {
 		buf[0] = '\0';
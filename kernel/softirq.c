@@ -307,6 +307,9 @@ void irq_exit(void)
 	/* Make sure that timer wheel updates are propagated */
 	if (idle_cpu(smp_processor_id()) && !in_interrupt() && !need_resched())
 		tick_nohz_stop_sched_tick(0);
+	/* And let a CPU running a single task stop or restart its tick */
+	if (!in_interrupt() && tick_nohz_full_cpu(smp_processor_id()))
+		tick_nohz_full_check();
 #endif
 	preempt_enable_no_resched();
 }
@@ -0,0 +1,178 @@
+/*
+ * Spinlock stress test
+ *
+ * Starts one kthread per online CPU (or nthreads of them), all hammering
+ * a single spinlock for a given number of seconds, and reports how many
+ * times the lock was taken in total and by the luckiest and unluckiest
+ * thread. Each critical section dirties a few cachelines of shared data,
+ * like a real hot lock would. Build the same kernel once with ticket
+ * spinlocks and once with CONFIG_QUEUED_SPINLOCKS to compare the two.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#include <linux/types.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/kthread.h>
+#include <linux/err.h>
+#include <linux/spinlock.h>
+#include <linux/sched.h>
+#include <linux/cpumask.h>
+#include <linux/completion.h>
+#include <linux/delay.h>
+#include <linux/slab.h>
+#include <linux/jiffies.h>
+#include <linux/cache.h>
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Spinlock stress test");
+
+static int nthreads = -1;	/* # threads, defaults to # online cpus */
+static int duration = 10;	/* seconds to run */
+static int hold = 4;		/* cachelines dirtied inside the lock */
+static int delay = 64;		/* cpu_relax() loops between acquisitions */
+
+module_param(nthreads, int, 0444);
+MODULE_PARM_DESC(nthreads, "Number of stress threads (default: one per cpu)");
+module_param(duration, int, 0444);
+MODULE_PARM_DESC(duration, "Number of seconds to run the test");
+module_param(hold, int, 0444);
+MODULE_PARM_DESC(hold, "Number of cachelines written while holding the lock");
+module_param(delay, int, 0444);
+MODULE_PARM_DESC(delay, "Number of cpu_relax() loops between acquisitions");
+
+#define STRESS_MAX_HOLD	64
+
+static DEFINE_SPINLOCK(stress_lock);
+static unsigned long stress_data[STRESS_MAX_HOLD][L1_CACHE_BYTES /
+						  sizeof(unsigned long)]
+	____cacheline_aligned_in_smp;
+
+static struct task_struct **stress_tasks;
+static unsigned long *stress_ops;
+static atomic_t stress_starting;
+static DECLARE_COMPLETION(stress_ready);
+static int stress_stop;
+
+static int spinlock_stress_thread(void *arg)
+{
+	unsigned long *ops = arg;
+	unsigned long n = 0;
+	int i;
+
+	if (atomic_dec_and_test(&stress_starting))
+		complete(&stress_ready);
+	while (!ACCESS_ONCE(stress_stop) && !kthread_should_stop()) {
+		spin_lock(&stress_lock);
+		for (i = 0; i < hold; i++)
+			stress_data[i][0]++;
+		spin_unlock(&stress_lock);
+		n++;
+
+		for (i = 0; i < delay; i++)
+			cpu_relax();
+		if (!(n & 1023))
+			cond_resched();
+	}
+	*ops = n;
+
+	while (!kthread_should_stop())
+		schedule_timeout_interruptible(1);
+	return 0;
+}
+
+static void spinlock_stress_cleanup(void)
+{
+	int i;
+
+	for (i = 0; i < nthreads; i++)
+		if (stress_tasks[i])
+			kthread_stop(stress_tasks[i]);
+	kfree(stress_tasks);
+	kfree(stress_ops);
+}
+
+static int __init spinlock_stress_init(void)
+{
+	unsigned long total = 0, lo = ULONG_MAX, hi = 0;
+	unsigned long start, elapsed;
+	int i, cpu;
+
+	if (nthreads < 0)
+		nthreads = num_online_cpus();
+	if (nthreads <= 0 || duration <= 0)
+		return -EINVAL;
+	hold = clamp(hold, 0, STRESS_MAX_HOLD);
+
+	stress_tasks = kcalloc(nthreads, sizeof(*stress_tasks), GFP_KERNEL);
+	stress_ops = kcalloc(nthreads, sizeof(*stress_ops), GFP_KERNEL);
+	if (!stress_tasks || !stress_ops) {
+		kfree(stress_tasks);
+		kfree(stress_ops);
+		return -ENOMEM;
+	}
+
+	atomic_set(&stress_starting, nthreads);
+	cpu = cpumask_first(cpu_online_mask);
+	for (i = 0; i < nthreads; i++) {
+		struct task_struct *t;
+
+		t = kthread_create(spinlock_stress_thread, &stress_ops[i],
+				   "spinlock_stress/%d", i);
+		if (IS_ERR(t)) {
+			printk(KERN_ERR "spinlock_stress: failed to create "
+			       "thread %d\n", i);
+			stress_stop = 1;
+			spinlock_stress_cleanup();
+			return PTR_ERR(t);
+		}
+		kthread_bind(t, cpu);
+		stress_tasks[i] = t;
+
+		cpu = cpumask_next(cpu, cpu_online_mask);
+		if (cpu >= nr_cpu_ids)
+			cpu = cpumask_first(cpu_online_mask);
+	}
+
+	for (i = 0; i < nthreads; i++)
+		wake_up_process(stress_tasks[i]);
+	wait_for_completion(&stress_ready);
+
+	start = jiffies;
+	msleep(duration * MSEC_PER_SEC);
+	ACCESS_ONCE(stress_stop) = 1;
+	elapsed = jiffies - start;
+
+	for (i = 0; i < nthreads; i++) {
+		kthread_stop(stress_tasks[i]);
+		stress_tasks[i] = NULL;
+		total += stress_ops[i];
+		lo = min(lo, stress_ops[i]);
+		hi = max(hi, stress_ops[i]);
+	}
+	spinlock_stress_cleanup();
+
+	printk(KERN_INFO "spinlock_stress: %s, %d threads, hold %d, delay %d: "
+	       "%lu acquisitions in %u ms (%lu/s), per thread min %lu max %lu\n",
+#ifdef CONFIG_QUEUED_SPINLOCKS
+	       "queued",
+#else
+	       "ticket",
+#endif
+	       nthreads, hold, delay, total, jiffies_to_msecs(elapsed),
+	       total * HZ / max(elapsed, 1UL), lo, hi);
+
+	return 0;
+}
+
+static void __exit spinlock_stress_exit(void)
+{
+}
+
+module_init(spinlock_stress_init);
+module_exit(spinlock_stress_exit);
@@ -38,14 +38,24 @@ struct stop_machine_data {
 static unsigned int num_threads;
 static atomic_t thread_ack;
 static DEFINE_MUTEX(lock);
-/* setup_lock protects refcount, stop_machine_wq and stop_machine_work. */
-static DEFINE_MUTEX(setup_lock);
-/* Users of stop_machine. */
-static int refcount;
-static struct workqueue_struct *stop_machine_wq;
 static struct stop_machine_data active, idle;
 static const struct cpumask *active_cpus;
-static void __percpu *stop_machine_work;
+
+/*
+ * Each cpu has a SCHED_FIFO stopper thread which runs stop_cpu()
+ * whenever it's kicked by __stop_machine().  Workqueues can't be used
+ * for this as their workers aren't RT and aren't guaranteed to stay on
+ * their cpu while it's going down.
+ */
+struct cpu_stopper {
+	struct task_struct	*thread;
+	bool			pending;	/* stop_cpu() requested */
+};
+static DEFINE_PER_CPU(struct cpu_stopper, cpu_stopper);
+
+/* Number of stoppers yet to finish and who to tell when they have. */
+static atomic_t stoppers_running;
+static struct completion *stoppers_done;
 
 static void set_state(enum stopmachine_state newstate)
 {
@@ -63,8 +73,8 @@ static void ack_state(void)
 }
 
 /* This is the actual function which stops the CPU. It runs
- * in the context of a dedicated stopmachine workqueue. */
-static void stop_cpu(struct work_struct *unused)
+ * in the context of the cpu's stopper thread. */
+static void stop_cpu(void)
 {
 	enum stopmachine_state curstate = STOPMACHINE_NONE;
 	struct stop_machine_data *smdata = &idle;
@@ -112,46 +122,116 @@ static int chill(void *unused)
 	return 0;
 }
 
-int stop_machine_create(void)
+static int cpu_stopper_thread(void *data)
 {
-	mutex_lock(&setup_lock);
-	if (refcount)
-		goto done;
-	stop_machine_wq = create_rt_workqueue("kstop");
-	if (!stop_machine_wq)
-		goto err_out;
-	stop_machine_work = alloc_percpu(struct work_struct);
-	if (!stop_machine_work)
-		goto err_out;
-done:
-	refcount++;
-	mutex_unlock(&setup_lock);
+	struct cpu_stopper *stopper = data;
+
+	for (;;) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (kthread_should_stop())
+			break;
+		if (!stopper->pending) {
+			schedule();
+			continue;
+		}
+		__set_current_state(TASK_RUNNING);
+
+		stopper->pending = false;
+		stop_cpu();
+		if (atomic_dec_and_test(&stoppers_running))
+			complete(stoppers_done);
+	}
+	__set_current_state(TASK_RUNNING);
 	return 0;
+}
+
+static int __cpuinit cpu_stop_cpu_callback(struct notifier_block *nfb,
+					   unsigned long action, void *hcpu)
+{
+	struct sched_param param = { .sched_priority = MAX_RT_PRIO - 1 };
+	unsigned int cpu = (unsigned long)hcpu;
+	struct cpu_stopper *stopper = &per_cpu(cpu_stopper, cpu);
+	struct task_struct *p;
+
+	switch (action & ~CPU_TASKS_FROZEN) {
+	case CPU_UP_PREPARE:
+		BUG_ON(stopper->thread);
+		p = kthread_create(cpu_stopper_thread, stopper, "kstop/%u",
+				   cpu);
+		if (IS_ERR(p))
+			return NOTIFY_BAD;
+		kthread_bind(p, cpu);
+		sched_setscheduler_nocheck(p, SCHED_FIFO, &param);
+		get_task_struct(p);
+		stopper->thread = p;
+		break;
 
-err_out:
-	if (stop_machine_wq)
-		destroy_workqueue(stop_machine_wq);
-	mutex_unlock(&setup_lock);
-	return -ENOMEM;
+	case CPU_ONLINE:
+		/* Strictly unnecessary, as first user will wake it. */
+		wake_up_process(stopper->thread);
+		break;
+
+#ifdef CONFIG_HOTPLUG_CPU
+	case CPU_UP_CANCELED:
+		if (!stopper->thread)
+			break;
+		/* Unbind it from offline cpu so it can run. */
+		kthread_bind(stopper->thread, cpumask_any(cpu_online_mask));
+		/* fall through */
+	case CPU_DEAD:
+		kthread_stop(stopper->thread);
+		put_task_struct(stopper->thread);
+		stopper->thread = NULL;
+		break;
+#endif
+	}
+	return NOTIFY_OK;
+}
+
+/*
+ * Give it a higher priority so that the stopper is created before any
+ * other notifier of a coming up cpu may need it and destroyed after
+ * the others are done with a dead one.
+ */
+static struct notifier_block __cpuinitdata cpu_stop_cpu_notifier = {
+	.notifier_call	= cpu_stop_cpu_callback,
+	.priority	= 10,
+};
+
+static int __init cpu_stop_init(void)
+{
+	void *bcpu = (void *)(long)smp_processor_id();
+	int err;
+
+	/* Start one for the boot CPU */
+	err = cpu_stop_cpu_callback(&cpu_stop_cpu_notifier, CPU_UP_PREPARE,
+				    bcpu);
+	BUG_ON(err == NOTIFY_BAD);
+	cpu_stop_cpu_callback(&cpu_stop_cpu_notifier, CPU_ONLINE, bcpu);
+	register_cpu_notifier(&cpu_stop_cpu_notifier);
+
+	return 0;
+}
+early_initcall(cpu_stop_init);
+
+/*
+ * The stopper threads are permanent now, stop_machine_create() and
+ * stop_machine_destroy() are kept for their callers and can't fail.
+ */
+int stop_machine_create(void)
+{
+	return 0;
 }
 EXPORT_SYMBOL_GPL(stop_machine_create);
 
 void stop_machine_destroy(void)
 {
-	mutex_lock(&setup_lock);
-	refcount--;
-	if (refcount)
-		goto done;
-	destroy_workqueue(stop_machine_wq);
-	free_percpu(stop_machine_work);
-done:
-	mutex_unlock(&setup_lock);
 }
 EXPORT_SYMBOL_GPL(stop_machine_destroy);
 
 int __stop_machine(int (*fn)(void *), void *data, const struct cpumask *cpus)
 {
-	struct work_struct *sm_work;
+	DECLARE_COMPLETION_ONSTACK(done);
 	int i, ret;
 
 	/* Set up initial state. */
@@ -164,19 +244,23 @@ int __stop_machine(int (*fn)(void *), void *data, const struct cpumask *cpus)
 	idle.fn = chill;
 	idle.data = NULL;
 
+	atomic_set(&stoppers_running, num_threads);
+	stoppers_done = &done;
+
 	set_state(STOPMACHINE_PREPARE);
 
-	/* Schedule the stop_cpu work on all cpus: hold this CPU so one
+	/* Kick the stopper on all cpus: hold this CPU so one
 	 * doesn't hit this CPU until we're ready. */
 	get_cpu();
 	for_each_online_cpu(i) {
-		sm_work = per_cpu_ptr(stop_machine_work, i);
-		INIT_WORK(sm_work, stop_cpu);
-		queue_work_on(i, stop_machine_wq, sm_work);
+		struct cpu_stopper *stopper = &per_cpu(cpu_stopper, i);
+
+		stopper->pending = true;
+		wake_up_process(stopper->thread);
 	}
 	/* This will release the thread on our CPU. */
 	put_cpu();
-	flush_workqueue(stop_machine_wq);
+	wait_for_completion(&done);
 	ret = active.fnret;
 	mutex_unlock(&lock);
 	return ret;
@@ -186,14 +270,10 @@ int stop_machine(int (*fn)(void *), void *data, const struct cpumask *cpus)
 {
 	int ret;
 
-	ret = stop_machine_create();
-	if (ret)
-		return ret;
 	/* No CPUs can come up or down during this. */
 	get_online_cpus();
 	ret = __stop_machine(fn, data, cpus);
 	put_online_cpus();
-	stop_machine_destroy();
 	return ret;
 }
 EXPORT_SYMBOL_GPL(stop_machine);
@@ -17,6 +17,7 @@
 #include <linux/interrupt.h>
 #include <linux/kernel_stat.h>
 #include <linux/percpu.h>
+#include <linux/posix-timers.h>
 #include <linux/profile.h>
 #include <linux/sched.h>
 #include <linux/tick.h>
@@ -124,6 +125,52 @@ static int __init setup_tick_nohz(char *str)
 
 __setup("nohz=", setup_tick_nohz);
 
+#ifdef CONFIG_NO_HZ_FULL
+/*
+ * Adaptive tick: the CPUs in tick_nohz_full_mask also stop the tick
+ * while they run a single task.  Whether the tick can be stopped is
+ * reevaluated on every irq_exit(), and the tick is restarted on entry
+ * to schedule() and whenever a second task is enqueued.  While the
+ * tick is stopped it is still programmed for the next timer wheel
+ * event, and at least once a second so that scheduler statistics and
+ * the running task's CPU time stay roughly up to date.
+ */
+cpumask_var_t tick_nohz_full_mask;
+bool tick_nohz_full_running __read_mostly;
+
+#define TICK_NOHZ_FULL_MAX_DEFER	HZ
+
+static int __init tick_nohz_full_setup(char *str)
+{
+	int cpu = smp_processor_id();
+
+	alloc_bootmem_cpumask_var(&tick_nohz_full_mask);
+	if (cpulist_parse(str, tick_nohz_full_mask) < 0) {
+		printk(KERN_WARNING "NOHZ: Incorrect nohz_full cpumask\n");
+		return 1;
+	}
+	if (cpumask_test_cpu(cpu, tick_nohz_full_mask)) {
+		printk(KERN_WARNING "NOHZ: Clearing %d from nohz_full range "
+		       "for timekeeping\n", cpu);
+		cpumask_clear_cpu(cpu, tick_nohz_full_mask);
+	}
+	tick_nohz_full_running = !cpumask_empty(tick_nohz_full_mask);
+	return 1;
+}
+__setup("nohz_full=", tick_nohz_full_setup);
+
+/*
+ * The CPUs running tickless rely on the do_timer() CPU for jiffies,
+ * so it must keep its tick even when idle.
+ */
+static int tick_nohz_full_timekeeper(int cpu)
+{
+	return tick_nohz_full_running && cpu == tick_do_timer_cpu;
+}
+#else
+static inline int tick_nohz_full_timekeeper(int cpu) { return 0; }
+#endif
+
 /**
  * tick_nohz_update_jiffies - update jiffies when idle was interrupted
  *
@@ -272,7 +319,7 @@ void tick_nohz_stop_sched_tick(int inidle)
 	} while (read_seqretry(&xtime_lock, seq));
 
 	if (rcu_needs_cpu(cpu) || printk_needs_cpu(cpu) ||
-	    arch_needs_cpu(cpu)) {
+	    arch_needs_cpu(cpu) || tick_nohz_full_timekeeper(cpu)) {
 		next_jiffies = last_jiffies + 1;
 		delta_jiffies = 1;
 	} else {
@@ -506,6 +553,173 @@ void tick_nohz_restart_sched_tick(void)
 	local_irq_enable();
 }
 
+#ifdef CONFIG_NO_HZ_FULL
+/*
+ * Charge the ticks the running task missed while the tick was stopped,
+ * except for the @covered ones the caller accounts itself.
+ */
+static void tick_nohz_full_account(struct tick_sched *ts,
+				   unsigned long covered, int hardirq_offset)
+{
+	unsigned long ticks = jiffies - ts->full_jiffies;
+#ifndef CONFIG_VIRT_CPU_ACCOUNTING
+	cputime_t t;
+#endif
+
+	ts->full_jiffies = jiffies;
+#ifndef CONFIG_VIRT_CPU_ACCOUNTING
+	if (ticks <= covered || ticks >= LONG_MAX)
+		return;
+	t = jiffies_to_cputime(ticks - covered);
+	if (ts->full_user)
+		account_user_time(current, t, cputime_to_scaled(t));
+	else
+		account_system_time(current, hardirq_offset, t,
+				    cputime_to_scaled(t));
+#endif
+}
+
+static int tick_nohz_full_can_stop(int cpu, struct tick_sched *ts)
+{
+	if (ts->nohz_mode == NOHZ_MODE_INACTIVE || ts->inidle)
+		return 0;
+	if (need_resched() || local_softirq_pending())
+		return 0;
+	if (cpu == tick_do_timer_cpu)
+		return 0;
+	if (!sched_can_stop_tick())
+		return 0;
+	if (posix_cpu_timers_need_tick(current))
+		return 0;
+	if (rcu_cpu_needs_tick(cpu) || printk_needs_cpu(cpu) ||
+	    arch_needs_cpu(cpu))
+		return 0;
+	return 1;
+}
+
+static void tick_nohz_full_restart(struct tick_sched *ts, ktime_t now)
+{
+	tick_nohz_full_account(ts, 0, 0);
+	ts->full_stopped = 0;
+	tick_nohz_restart(ts, now);
+}
+
+/*
+ * Stop the tick, or reprogram it if already stopped, for the next timer
+ * wheel event.  Must be called with interrupts disabled.
+ */
+static void tick_nohz_full_stop(int cpu, struct tick_sched *ts)
+{
+	struct clock_event_device *dev = __get_cpu_var(tick_cpu_device).evtdev;
+	struct pt_regs *regs = get_irq_regs();
+	unsigned long seq, last_jiffies, next_jiffies;
+	long delta_jiffies;
+	ktime_t last_update, expires;
+
+	do {
+		seq = read_seqbegin(&xtime_lock);
+		last_update = last_jiffies_update;
+		last_jiffies = jiffies;
+	} while (read_seqretry(&xtime_lock, seq));
+
+	next_jiffies = get_next_timer_interrupt(last_jiffies);
+	delta_jiffies = next_jiffies - last_jiffies;
+	if (delta_jiffies <= 1) {
+		if (!ts->full_stopped)
+			return;
+		delta_jiffies = 1;
+	}
+	if (delta_jiffies > TICK_NOHZ_FULL_MAX_DEFER)
+		delta_jiffies = TICK_NOHZ_FULL_MAX_DEFER;
+	expires = ktime_add_ns(last_update, tick_period.tv64 * delta_jiffies);
+
+	ts->full_user = regs && user_mode(regs);
+
+	/* Skip reprogram of event if its not changed */
+	if (ts->full_stopped && ktime_equal(expires, dev->next_event))
+		return;
+
+	if (!ts->full_stopped) {
+		ts->idle_tick = hrtimer_get_expires(&ts->sched_timer);
+		ts->full_stopped = 1;
+		ts->full_jiffies = last_jiffies;
+	}
+
+	if (ts->nohz_mode == NOHZ_MODE_HIGHRES) {
+		hrtimer_start(&ts->sched_timer, expires,
+			      HRTIMER_MODE_ABS_PINNED);
+		/* Check, if the timer was already in the past */
+		if (hrtimer_active(&ts->sched_timer))
+			return;
+	} else {
+		hrtimer_set_expires(&ts->sched_timer, expires);
+		if (!tick_program_event(expires, 0))
+			return;
+	}
+
+	/* We are past the event already, keep ticking. */
+	tick_nohz_full_restart(ts, ktime_get());
+}
+
+/**
+ * tick_nohz_full_check - stop or restart the tick of an adaptive-tick CPU
+ *
+ * Called from irq_exit() on the CPUs in tick_nohz_full_mask when not
+ * idle, with interrupts disabled.
+ */
+void tick_nohz_full_check(void)
+{
+	int cpu = smp_processor_id();
+	struct tick_sched *ts = &per_cpu(tick_cpu_sched, cpu);
+
+	if (idle_cpu(cpu) || ts->inidle)
+		return;
+
+	if (tick_nohz_full_can_stop(cpu, ts))
+		tick_nohz_full_stop(cpu, ts);
+	else if (ts->full_stopped)
+		tick_nohz_full_restart(ts, ktime_get());
+}
+
+/*
+ * Restart the tick on entry to schedule().  Once the new task mix has
+ * settled, the next irq_exit() stops it again if possible.
+ */
+void __tick_nohz_full_restart_tick(void)
+{
+	struct tick_sched *ts = &__get_cpu_var(tick_cpu_sched);
+	unsigned long flags;
+
+	if (!ts->full_stopped)
+		return;
+
+	local_irq_save(flags);
+	if (ts->full_stopped)
+		tick_nohz_full_restart(ts, ktime_get());
+	local_irq_restore(flags);
+}
+
+int __tick_nohz_full_stopped(int cpu)
+{
+	return per_cpu(tick_cpu_sched, cpu).full_stopped;
+}
+
+/*
+ * Called from the tick handler: account the ticks missed while the
+ * tick was stopped.  The running tick itself is left to the caller.
+ */
+static void tick_nohz_full_tick(struct tick_sched *ts)
+{
+	if (ts->full_stopped)
+		tick_nohz_full_account(ts, 1, HARDIRQ_OFFSET);
+}
+
+#else /* CONFIG_NO_HZ_FULL */
+
+static inline void tick_nohz_full_tick(struct tick_sched *ts) { }
+
+#endif /* CONFIG_NO_HZ_FULL */
+
 static int tick_nohz_reprogram(struct tick_sched *ts, ktime_t now)
 {
 	hrtimer_forward(&ts->sched_timer, now, tick_period);
@@ -531,7 +745,8 @@ static void tick_nohz_handler(struct clock_event_device *dev)
 	 * this duty, then the jiffies update is still serialized by
 	 * xtime_lock.
 	 */
-	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE))
+	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE) &&
+	    !tick_nohz_full_cpu(cpu))
 		tick_do_timer_cpu = cpu;
 
 	/* Check, if the jiffies need an update */
@@ -551,6 +766,7 @@ static void tick_nohz_handler(struct clock_event_device *dev)
 		ts->idle_jiffies++;
 	}
 
+	tick_nohz_full_tick(ts);
 	update_process_times(user_mode(regs));
 	profile_tick(CPU_PROFILING);
 
@@ -650,6 +866,7 @@ static inline void tick_check_nohz(int cpu)
 
 static inline void tick_nohz_switch_to_nohz(void) { }
 static inline void tick_check_nohz(int cpu) { }
+static inline void tick_nohz_full_tick(struct tick_sched *ts) { }
 
 #endif /* NO_HZ */
 
@@ -686,7 +903,8 @@ static enum hrtimer_restart tick_sched_timer(struct hrtimer *timer)
 	 * this duty, then the jiffies update is still serialized by
 	 * xtime_lock.
 	 */
-	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE))
+	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE) &&
+	    !tick_nohz_full_cpu(cpu))
 		tick_do_timer_cpu = cpu;
 #endif
 
@@ -711,6 +929,7 @@ static enum hrtimer_restart tick_sched_timer(struct hrtimer *timer)
 			touch_softlockup_watchdog();
 			ts->idle_jiffies++;
 		}
+		tick_nohz_full_tick(ts);
 		update_process_times(user_mode(regs));
 		profile_tick(CPU_PROFILING);
 	}
@@ -770,6 +989,9 @@ void tick_cancel_sched_timer(int cpu)
 # endif
 
 	ts->nohz_mode = NOHZ_MODE_INACTIVE;
+# ifdef CONFIG_NO_HZ_FULL
+	ts->full_stopped = 0;
+# endif
 }
 #endif
 
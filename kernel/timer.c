@@ -40,6 +40,8 @@
 #include <linux/perf_event.h>
 #include <linux/sched.h>
 #include <linux/slab.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
 
 #include <asm/uaccess.h>
 #include <asm/unistd.h>
@@ -55,35 +57,128 @@ u64 jiffies_64 __cacheline_aligned_in_smp = INITIAL_JIFFIES;
 EXPORT_SYMBOL(jiffies_64);
 
 /*
- * per-CPU timer vector definitions:
+ * The timer wheel has LVL_DEPTH array levels. Each level provides an array of
+ * LVL_SIZE buckets. Each level is driven by its own clock and therefore each
+ * level has a different granularity.
+ *
+ * The level granularity is:		LVL_CLK_DIV ^ lvl
+ * The level clock frequency is:	HZ / (LVL_CLK_DIV ^ level)
+ *
+ * The array level of a newly armed timer depends on the relative expiry
+ * time. The farther the expiry time is away the higher the array level and
+ * therefore the granularity becomes.
+ *
+ * Contrary to the original timer wheel implementation, which aims for 'exact'
+ * expiry of the timers, this implementation removes the need for recascading
+ * the timers into the lower array levels: a timer stays in the bucket it was
+ * queued to until it expires or is deleted. The price is granularity loss
+ * for timers which are far out. The granularity levels provide implicit
+ * batching of expiries; callers which can tolerate more can ask for explicit
+ * slack with set_timer_slack().
+ *
+ * This is an optimization of the original timer wheel implementation for the
+ * majority of the timer wheel use cases: timeouts. The vast majority of
+ * timeout timers (networking, disk I/O ...) are canceled before expiry. If
+ * the timeout expires it indicates that normal operation is disturbed, so it
+ * does not matter much whether the timeout comes with a slight delay.
+ *
+ * Timers in level 0 expire exactly at their expiry time. Timers in the
+ * higher levels are rounded up to the level granularity, so they never fire
+ * early, and fire at most LVL_CLK_DIV ^ lvl - 1 jiffies late. For HZ=1000:
+ *
+ * Level Offset  Granularity            Range
+ *  0      0         1 ms                0 ms -         62 ms
+ *  1     64         8 ms               63 ms -        503 ms
+ *  2    128        64 ms              504 ms -       4031 ms (504ms - ~4s)
+ *  3    192       512 ms             4032 ms -      32255 ms (~4s - ~32s)
+ *  4    256      4096 ms (~4s)      32256 ms -     258047 ms (~32s - ~4m)
+ *  5    320     32768 ms (~32s)    258048 ms -    2064383 ms (~4m - ~34m)
+ *  6    384    262144 ms (~4m)    2064384 ms -   16515071 ms (~34m - ~4h)
+ *  7    448   2097152 ms (~34m)  16515072 ms -  132120575 ms (~4h - ~1d)
+ *  8    512  16777216 ms (~4h)  132120576 ms - 1056964607 ms (~1d - ~12d)
+ *
+ * Timers which are farther out than the last level can hold are queued
+ * with the maximum timeout of the wheel (see WHEEL_TIMEOUT_MAX).
  */
-#define TVN_BITS (CONFIG_BASE_SMALL ? 4 : 6)
-#define TVR_BITS (CONFIG_BASE_SMALL ? 6 : 8)
-#define TVN_SIZE (1 << TVN_BITS)
-#define TVR_SIZE (1 << TVR_BITS)
-#define TVN_MASK (TVN_SIZE - 1)
-#define TVR_MASK (TVR_SIZE - 1)
-
-struct tvec {
-	struct list_head vec[TVN_SIZE];
-};
 
-struct tvec_root {
-	struct list_head vec[TVR_SIZE];
+/* Clock divisor for the next level */
+#define LVL_CLK_SHIFT	3
+#define LVL_CLK_DIV	(1UL << LVL_CLK_SHIFT)
+#define LVL_CLK_MASK	(LVL_CLK_DIV - 1)
+#define LVL_SHIFT(n)	((n) * LVL_CLK_SHIFT)
+#define LVL_GRAN(n)	(1UL << LVL_SHIFT(n))
+
+/*
+ * The time start value for each level to select the bucket at enqueue
+ * time.
+ */
+#define LVL_START(n)	((LVL_SIZE - 1) << (((n) - 1) * LVL_CLK_SHIFT))
+
+/* Size of each clock level */
+#define LVL_BITS	6
+#define LVL_SIZE	(1UL << LVL_BITS)
+#define LVL_MASK	(LVL_SIZE - 1)
+#define LVL_OFFS(n)	((n) * LVL_SIZE)
+
+/* Level depth */
+#if HZ > 100
+# define LVL_DEPTH	9
+#else
+# define LVL_DEPTH	8
+#endif
+
+/* The cutoff (max. capacity of the wheel) */
+#define WHEEL_TIMEOUT_CUTOFF	(LVL_START(LVL_DEPTH))
+#define WHEEL_TIMEOUT_MAX	(WHEEL_TIMEOUT_CUTOFF - LVL_GRAN(LVL_DEPTH - 1))
+
+/* The resulting wheel size */
+#define WHEEL_SIZE	(LVL_SIZE * LVL_DEPTH)
+
+#ifdef CONFIG_TIMER_STATS
+/*
+ * Per-CPU timer wheel statistics, see /proc/timer_wheel:
+ */
+struct tvec_stats {
+	unsigned long	runs;		/* __run_timers() invocations */
+	unsigned long	ticks;		/* wheel clock advances */
+	unsigned long	buckets;	/* expired buckets collected */
+	unsigned long	expired;	/* timers expired */
+	unsigned long	max_batch;	/* max. timers expired in one run */
+	unsigned long	enqueued[LVL_DEPTH];
+	u64		collect_ns;	/* time spent collecting buckets */
+	u64		expire_ns;	/* time spent running callbacks */
 };
+#endif
 
 struct tvec_base {
 	spinlock_t lock;
 	struct timer_list *running_timer;
 	unsigned long timer_jiffies;
 	unsigned long next_timer;
-	struct tvec_root tv1;
-	struct tvec tv2;
-	struct tvec tv3;
-	struct tvec tv4;
-	struct tvec tv5;
+	unsigned long next_expiry;
+	DECLARE_BITMAP(pending_map, WHEEL_SIZE);
+	struct list_head vectors[WHEEL_SIZE];
+#ifdef CONFIG_TIMER_STATS
+	struct tvec_stats stats;
+#endif
 } ____cacheline_aligned;
 
+#ifdef CONFIG_TIMER_STATS
+#define timer_wheel_stats_inc(base, field)	((base)->stats.field++)
+#define timer_wheel_stats_add(base, field, n)	((base)->stats.field += (n))
+#define timer_wheel_stats_max(base, field, n)			\
+	do {							\
+		if ((n) > (base)->stats.field)			\
+			(base)->stats.field = (n);		\
+	} while (0)
+#define timer_wheel_clock()			cpu_clock(smp_processor_id())
+#else
+#define timer_wheel_stats_inc(base, field)	do { } while (0)
+#define timer_wheel_stats_add(base, field, n)	do { (void)(n); } while (0)
+#define timer_wheel_stats_max(base, field, n)	do { (void)(n); } while (0)
+#define timer_wheel_clock()			0ULL
+#endif
+
 struct tvec_base boot_tvec_bases;
 EXPORT_SYMBOL(boot_tvec_bases);
 static DEFINE_PER_CPU(struct tvec_base *, tvec_bases) = &boot_tvec_bases;
@@ -328,46 +423,68 @@ static inline void set_running_timer(struct tvec_base *base,
 #endif
 }
 
-static void internal_add_timer(struct tvec_base *base, struct timer_list *timer)
+/*
+ * Helper function to calculate the array index for a given expiry
+ * time. The expiry is rounded up to the level granularity, so a
+ * timer never expires early.
+ */
+static inline unsigned calc_index(unsigned long expires, unsigned lvl)
 {
-	unsigned long expires = timer->expires;
-	unsigned long idx = expires - base->timer_jiffies;
-	struct list_head *vec;
+	expires = (expires + LVL_GRAN(lvl) - 1) >> LVL_SHIFT(lvl);
+	return LVL_OFFS(lvl) + (expires & LVL_MASK);
+}
 
-	if (idx < TVR_SIZE) {
-		int i = expires & TVR_MASK;
-		vec = base->tv1.vec + i;
-	} else if (idx < 1 << (TVR_BITS + TVN_BITS)) {
-		int i = (expires >> TVR_BITS) & TVN_MASK;
-		vec = base->tv2.vec + i;
-	} else if (idx < 1 << (TVR_BITS + 2 * TVN_BITS)) {
-		int i = (expires >> (TVR_BITS + TVN_BITS)) & TVN_MASK;
-		vec = base->tv3.vec + i;
-	} else if (idx < 1 << (TVR_BITS + 3 * TVN_BITS)) {
-		int i = (expires >> (TVR_BITS + 2 * TVN_BITS)) & TVN_MASK;
-		vec = base->tv4.vec + i;
-	} else if ((signed long) idx < 0) {
+static unsigned calc_wheel_index(struct tvec_base *base, unsigned long expires,
+				 unsigned *level)
+{
+	unsigned long delta = expires - base->timer_jiffies;
+	unsigned lvl;
+
+	if ((long) delta < 0) {
 		/*
 		 * Can happen if you add a timer with expires == jiffies,
 		 * or you set a timer to go off in the past
 		 */
-		vec = base->tv1.vec + (base->timer_jiffies & TVR_MASK);
-	} else {
-		int i;
-		/* If the timeout is larger than 0xffffffff on 64-bit
-		 * architectures then we use the maximum timeout:
+		*level = 0;
+		return base->timer_jiffies & LVL_MASK;
+	}
+
+	if (delta >= WHEEL_TIMEOUT_CUTOFF) {
+		/*
+		 * Force expire obscene large timeouts to expire at the
+		 * capacity limit of the wheel.
 		 */
-		if (idx > 0xffffffffUL) {
-			idx = 0xffffffffUL;
-			expires = idx + base->timer_jiffies;
-		}
-		i = (expires >> (TVR_BITS + 3 * TVN_BITS)) & TVN_MASK;
-		vec = base->tv5.vec + i;
+		expires = base->timer_jiffies + WHEEL_TIMEOUT_MAX;
+		lvl = LVL_DEPTH - 1;
+	} else {
+		for (lvl = 0; lvl < LVL_DEPTH - 1; lvl++)
+			if (delta < LVL_START(lvl + 1))
+				break;
 	}
+	*level = lvl;
+	return calc_index(expires, lvl);
+}
+
+#ifdef CONFIG_NO_HZ
+static void forward_timer_base(struct tvec_base *base);
+#else
+static inline void forward_timer_base(struct tvec_base *base) { }
+#endif
+
+static void internal_add_timer(struct tvec_base *base, struct timer_list *timer)
+{
+	unsigned lvl, idx = calc_wheel_index(base, timer->expires, &lvl);
+
+	/* Lower bound on the first expiry, deferrable timers included */
+	if (time_before(timer->expires, base->next_expiry))
+		base->next_expiry = timer->expires;
+
 	/*
 	 * Timers are FIFO:
 	 */
-	list_add_tail(&timer->entry, vec);
+	list_add_tail(&timer->entry, base->vectors + idx);
+	__set_bit(idx, base->pending_map);
+	timer_wheel_stats_inc(base, enqueued[lvl]);
 }
 
 #ifdef CONFIG_TIMER_STATS
@@ -550,6 +667,7 @@ static void __init_timer(struct timer_list *timer,
 {
 	timer->entry.next = NULL;
 	timer->base = __raw_get_cpu_var(tvec_bases);
+	timer->slack = 0;
 #ifdef CONFIG_TIMER_STATS
 	timer->start_site = NULL;
 	timer->start_pid = -1;
@@ -599,6 +717,24 @@ static inline void detach_timer(struct timer_list *timer,
 	entry->prev = LIST_POISON2;
 }
 
+/*
+ * Remove a timer from its wheel bucket and clear the pending bit of the
+ * bucket when the timer was the last one queued there. Timers which
+ * __run_timers() has already collected for expiry sit on a private list
+ * and have no pending bit.
+ */
+static inline void detach_wheel_timer(struct tvec_base *base,
+				      struct timer_list *timer,
+				      int clear_pending)
+{
+	struct list_head *head = timer->entry.next;
+
+	if (head == timer->entry.prev &&
+	    head >= base->vectors && head < base->vectors + WHEEL_SIZE)
+		__clear_bit(head - base->vectors, base->pending_map);
+	detach_timer(timer, clear_pending);
+}
+
 /*
  * We are using hashed locking: holding per_cpu(tvec_bases).lock
  * means that all timers which are tied to this base via timer->base are
@@ -645,7 +781,7 @@ __mod_timer(struct timer_list *timer, unsigned long expires,
 	base = lock_timer_base(timer, &flags);
 
 	if (timer_pending(timer)) {
-		detach_timer(timer, 0);
+		detach_wheel_timer(base, timer, 0);
 		if (timer->expires == base->next_timer &&
 		    !tbase_get_deferrable(timer->base))
 			base->next_timer = base->timer_jiffies;
@@ -687,12 +823,17 @@ __mod_timer(struct timer_list *timer, unsigned long expires,
 		}
 	}
 
+	forward_timer_base(base);
 	timer->expires = expires;
 	if (time_before(timer->expires, base->next_timer) &&
 	    !tbase_get_deferrable(timer->base))
 		base->next_timer = timer->expires;
 	internal_add_timer(base, timer);
 
+	/* A CPU running tickless has to notice the new timer. */
+	if (base == new_base)
+		wake_up_nohz_full_cpu(cpu);
+
 out_unlock:
 	spin_unlock_irqrestore(&base->lock, flags);
 
@@ -715,6 +856,55 @@ int mod_timer_pending(struct timer_list *timer, unsigned long expires)
 }
 EXPORT_SYMBOL(mod_timer_pending);
 
+/*
+ * Decide where to put the timer while taking the slack into account
+ *
+ * Algorithm:
+ *   1) calculate the maximum (absolute) time
+ *   2) calculate the highest bit where the expires and new max are different
+ *   3) use this bit to make a mask
+ *   4) use the bitmask to round down the maximum time, so that all last
+ *      bits are zeros
+ *
+ * All timers whose window overlaps end up on the same jiffy, and thereby
+ * in the same wheel bucket, and are expired in one go.
+ */
+static inline
+unsigned long apply_slack(struct timer_list *timer, unsigned long expires)
+{
+	unsigned long expires_limit, mask;
+	int bit;
+
+	if (!timer->slack)
+		return expires;
+
+	expires_limit = expires + timer->slack;
+	mask = expires ^ expires_limit;
+	bit = find_last_bit(&mask, BITS_PER_LONG);
+	mask = (1UL << bit) - 1;
+
+	return expires_limit & ~mask;
+}
+
+/**
+ * set_timer_slack - set the allowed slack for a timer
+ * @timer: the timer to be modified
+ * @slack_hz: the amount of time (in jiffies) allowed for rounding
+ *
+ * Set the amount of time, in jiffies, that a certain timer may fire
+ * late. By picking the expiry time within this window that has the
+ * most low-order zero bits, mod_timer() and add_timer() let timers
+ * of many callers share one expiry and be processed in a single batch.
+ *
+ * The timer wheel adds granularity loss of its own to timers which are
+ * far out; the slack is on top of that. By default a timer has no slack.
+ */
+void set_timer_slack(struct timer_list *timer, int slack_hz)
+{
+	timer->slack = max(slack_hz, 0);
+}
+EXPORT_SYMBOL_GPL(set_timer_slack);
+
 /**
  * mod_timer - modify a timer's timeout
  * @timer: the timer to be modified
@@ -737,6 +927,8 @@ EXPORT_SYMBOL(mod_timer_pending);
  */
 int mod_timer(struct timer_list *timer, unsigned long expires)
 {
+	expires = apply_slack(timer, expires);
+
 	/*
 	 * This is a common optimization triggered by the
 	 * networking code - if the timer is re-modified
@@ -809,6 +1001,7 @@ void add_timer_on(struct timer_list *timer, int cpu)
 	spin_lock_irqsave(&base->lock, flags);
 	timer_set_base(timer, base);
 	debug_activate(timer, timer->expires);
+	forward_timer_base(base);
 	if (time_before(timer->expires, base->next_timer) &&
 	    !tbase_get_deferrable(timer->base))
 		base->next_timer = timer->expires;
@@ -822,6 +1015,7 @@ void add_timer_on(struct timer_list *timer, int cpu)
 	 * the timer wheel.
 	 */
 	wake_up_idle_cpu(cpu);
+	wake_up_nohz_full_cpu(cpu);
 	spin_unlock_irqrestore(&base->lock, flags);
 }
 EXPORT_SYMBOL_GPL(add_timer_on);
@@ -847,7 +1041,7 @@ int del_timer(struct timer_list *timer)
 	if (timer_pending(timer)) {
 		base = lock_timer_base(timer, &flags);
 		if (timer_pending(timer)) {
-			detach_timer(timer, 1);
+			detach_wheel_timer(base, timer, 1);
 			if (timer->expires == base->next_timer &&
 			    !tbase_get_deferrable(timer->base))
 				base->next_timer = base->timer_jiffies;
@@ -884,7 +1078,7 @@ int try_to_del_timer_sync(struct timer_list *timer)
 	timer_stats_timer_clear_start_info(timer);
 	ret = 0;
 	if (timer_pending(timer)) {
-		detach_timer(timer, 1);
+		detach_wheel_timer(base, timer, 1);
 		if (timer->expires == base->next_timer &&
 		    !tbase_get_deferrable(timer->base))
 			base->next_timer = base->timer_jiffies;
@@ -935,189 +1129,268 @@ int del_timer_sync(struct timer_list *timer)
 EXPORT_SYMBOL(del_timer_sync);
 #endif
 
-static int cascade(struct tvec_base *base, struct tvec *tv, int index)
+static unsigned long expire_timers(struct tvec_base *base,
+				   struct list_head *head)
 {
-	/* cascade all the timers from tv up one level */
-	struct timer_list *timer, *tmp;
-	struct list_head tv_list;
+	unsigned long count = 0;
 
-	list_replace_init(tv->vec + index, &tv_list);
+	while (!list_empty(head)) {
+		struct timer_list *timer;
+		void (*fn)(unsigned long);
+		unsigned long data;
 
-	/*
-	 * We are removing _all_ timers from the list, so we
-	 * don't have to detach them individually.
-	 */
-	list_for_each_entry_safe(timer, tmp, &tv_list, entry) {
-		BUG_ON(tbase_get_base(timer->base) != base);
-		internal_add_timer(base, timer);
-	}
+		timer = list_first_entry(head, struct timer_list, entry);
+		fn = timer->function;
+		data = timer->data;
+
+		timer_stats_account_timer(timer);
+		count++;
+
+		set_running_timer(base, timer);
+		detach_timer(timer, 1);
 
-	return index;
+		spin_unlock_irq(&base->lock);
+		{
+			int preempt_count = preempt_count();
+
+#ifdef CONFIG_LOCKDEP
+			/*
+			 * It is permissible to free the timer from
+			 * inside the function that is called from
+			 * it, this we need to take into account for
+			 * lockdep too. To avoid bogus "held lock
+			 * freed" warnings as well as problems when
+			 * looking into timer->lockdep_map, make a
+			 * copy and use that here.
+			 */
+			struct lockdep_map lockdep_map = timer->lockdep_map;
+#endif
+			/*
+			 * Couple the lock chain with the lock chain at
+			 * del_timer_sync() by acquiring the lock_map
+			 * around the fn() call here and in
+			 * del_timer_sync().
+			 */
+			lock_map_acquire(&lockdep_map);
+
+			trace_timer_expire_entry(timer);
+			fn(data);
+			trace_timer_expire_exit(timer);
+
+			lock_map_release(&lockdep_map);
+
+			if (preempt_count != preempt_count()) {
+				printk(KERN_ERR "huh, entered %p "
+				       "with preempt_count %08x, exited"
+				       " with %08x?\n",
+				       fn, preempt_count,
+				       preempt_count());
+				BUG();
+			}
+		}
+		spin_lock_irq(&base->lock);
+	}
+	timer_wheel_stats_add(base, expired, count);
+	return count;
 }
 
-#define INDEX(N) ((base->timer_jiffies >> (TVR_BITS + (N) * TVN_BITS)) & TVN_MASK)
+/*
+ * Move the timers of all buckets which expire at base->timer_jiffies
+ * onto @heads, one list per level. Returns the number of lists filled.
+ */
+static int collect_expired_timers(struct tvec_base *base,
+				  struct list_head *heads)
+{
+	unsigned long clk = base->timer_jiffies;
+	struct list_head *vec;
+	int i, levels = 0;
+	unsigned int idx;
+
+	for (i = 0; i < LVL_DEPTH; i++) {
+		idx = (clk & LVL_MASK) + i * LVL_SIZE;
+
+		if (__test_and_clear_bit(idx, base->pending_map)) {
+			vec = base->vectors + idx;
+			list_replace_init(vec, heads + levels);
+			levels++;
+		}
+		/* Is it time to look at the next level? */
+		if (clk & LVL_CLK_MASK)
+			break;
+		/* Shift clock for the next level granularity */
+		clk >>= LVL_CLK_SHIFT;
+	}
+	return levels;
+}
 
 /**
  * __run_timers - run all expired timers (if any) on this CPU.
  * @base: the timer vector to be processed.
  *
- * This function cascades all vectors and executes all expired timer
- * vectors.
+ * This function collects the expired buckets of all wheel levels and
+ * executes the timers queued in them. Nothing is ever cascaded.
  */
 static inline void __run_timers(struct tvec_base *base)
 {
-	struct timer_list *timer;
+	struct list_head heads[LVL_DEPTH];
+	unsigned long expired = 0;
+	u64 start, now;
+	int levels;
 
 	spin_lock_irq(&base->lock);
+	timer_wheel_stats_inc(base, runs);
 	while (time_after_eq(jiffies, base->timer_jiffies)) {
-		struct list_head work_list;
-		struct list_head *head = &work_list;
-		int index = base->timer_jiffies & TVR_MASK;
-
-		/*
-		 * Cascade timers:
-		 */
-		if (!index &&
-			(!cascade(base, &base->tv2, INDEX(0))) &&
-				(!cascade(base, &base->tv3, INDEX(1))) &&
-					!cascade(base, &base->tv4, INDEX(2)))
-			cascade(base, &base->tv5, INDEX(3));
+		start = timer_wheel_clock();
+		levels = collect_expired_timers(base, heads);
 		++base->timer_jiffies;
-		list_replace_init(base->tv1.vec + index, &work_list);
-		while (!list_empty(head)) {
-			void (*fn)(unsigned long);
-			unsigned long data;
-
-			timer = list_first_entry(head, struct timer_list,entry);
-			fn = timer->function;
-			data = timer->data;
-
-			timer_stats_account_timer(timer);
-
-			set_running_timer(base, timer);
-			detach_timer(timer, 1);
-
-			spin_unlock_irq(&base->lock);
-			{
-				int preempt_count = preempt_count();
-
-#ifdef CONFIG_LOCKDEP
-				/*
-				 * It is permissible to free the timer from
-				 * inside the function that is called from
-				 * it, this we need to take into account for
-				 * lockdep too. To avoid bogus "held lock
-				 * freed" warnings as well as problems when
-				 * looking into timer->lockdep_map, make a
-				 * copy and use that here.
-				 */
-				struct lockdep_map lockdep_map =
-					timer->lockdep_map;
-#endif
-				/*
-				 * Couple the lock chain with the lock chain at
-				 * del_timer_sync() by acquiring the lock_map
-				 * around the fn() call here and in
-				 * del_timer_sync().
-				 */
-				lock_map_acquire(&lockdep_map);
-
-				trace_timer_expire_entry(timer);
-				fn(data);
-				trace_timer_expire_exit(timer);
-
-				lock_map_release(&lockdep_map);
-
-				if (preempt_count != preempt_count()) {
-					printk(KERN_ERR "huh, entered %p "
-					       "with preempt_count %08x, exited"
-					       " with %08x?\n",
-					       fn, preempt_count,
-					       preempt_count());
-					BUG();
-				}
-			}
-			spin_lock_irq(&base->lock);
-		}
+		now = timer_wheel_clock();
+		timer_wheel_stats_inc(base, ticks);
+		timer_wheel_stats_add(base, collect_ns, now - start);
+		if (!levels)
+			continue;
+
+		timer_wheel_stats_add(base, buckets, levels);
+		while (levels--)
+			expired += expire_timers(base, heads + levels);
+		timer_wheel_stats_add(base, expire_ns, timer_wheel_clock() - now);
 	}
+	timer_wheel_stats_max(base, max_batch, expired);
 	set_running_timer(base, NULL);
 	spin_unlock_irq(&base->lock);
 }
 
 #ifdef CONFIG_NO_HZ
+/*
+ * Find the first bucket in [@from, @to) which holds a non deferrable
+ * timer, or any timer if @deferrable is set. Returns its index or -1.
+ */
+static int first_pending_bucket(struct tvec_base *base, unsigned from,
+				unsigned to, bool deferrable)
+{
+	struct timer_list *nte;
+	unsigned pos;
+
+	for (pos = find_next_bit(base->pending_map, to, from); pos < to;
+	     pos = find_next_bit(base->pending_map, to, pos + 1)) {
+		if (deferrable)
+			return pos;
+		list_for_each_entry(nte, base->vectors + pos, entry) {
+			if (!tbase_get_deferrable(nte->base))
+				return pos;
+		}
+	}
+	return -1;
+}
+
+/*
+ * Search the first expiring bucket of the level starting at @offset,
+ * beginning at the level clock position @clk. Returns the distance in
+ * buckets or -1 when the level holds no non deferrable timer.
+ */
+static int next_pending_bucket(struct tvec_base *base, unsigned offset,
+			       unsigned clk, bool deferrable)
+{
+	unsigned start = offset + clk;
+	int pos;
+
+	pos = first_pending_bucket(base, start, offset + LVL_SIZE, deferrable);
+	if (pos >= 0)
+		return pos - start;
+
+	pos = first_pending_bucket(base, offset, start, deferrable);
+	return pos >= 0 ? pos + LVL_SIZE - start : -1;
+}
+
 /*
  * Find out when the next timer event is due to happen. This
  * is used on S/390 to stop all activity when a CPU is idle.
  * This function needs to be called with interrupts disabled.
  */
-static unsigned long __next_timer_interrupt(struct tvec_base *base)
+static unsigned long __next_timer_interrupt(struct tvec_base *base,
+					    bool deferrable)
 {
-	unsigned long timer_jiffies = base->timer_jiffies;
-	unsigned long expires = timer_jiffies + NEXT_TIMER_MAX_DELTA;
-	int index, slot, array, found = 0;
-	struct timer_list *nte;
-	struct tvec *varray[4];
-
-	/* Look for timer events in tv1. */
-	index = slot = timer_jiffies & TVR_MASK;
-	do {
-		list_for_each_entry(nte, base->tv1.vec + slot, entry) {
-			if (tbase_get_deferrable(nte->base))
-				continue;
-
-			found = 1;
-			expires = nte->expires;
-			/* Look at the cascade bucket(s)? */
-			if (!index || slot < index)
-				goto cascade;
-			return expires;
-		}
-		slot = (slot + 1) & TVR_MASK;
-	} while (slot != index);
-
-cascade:
-	/* Calculate the next cascade event */
-	if (index)
-		timer_jiffies += TVR_SIZE - index;
-	timer_jiffies >>= TVR_BITS;
-
-	/* Check tv2-tv5. */
-	varray[0] = &base->tv2;
-	varray[1] = &base->tv3;
-	varray[2] = &base->tv4;
-	varray[3] = &base->tv5;
-
-	for (array = 0; array < 4; array++) {
-		struct tvec *varp = varray[array];
-
-		index = slot = timer_jiffies & TVN_MASK;
-		do {
-			list_for_each_entry(nte, varp->vec + slot, entry) {
-				if (tbase_get_deferrable(nte->base))
-					continue;
-
-				found = 1;
-				if (time_before(nte->expires, expires))
-					expires = nte->expires;
-			}
-			/*
-			 * Do we still search for the first timer or are
-			 * we looking up the cascade buckets ?
-			 */
-			if (found) {
-				/* Look at the cascade bucket(s)? */
-				if (!index || slot < index)
-					break;
-				return expires;
-			}
-			slot = (slot + 1) & TVN_MASK;
-		} while (slot != index);
+	unsigned long clk, next, adj;
+	unsigned lvl, offset = 0;
+
+	next = base->timer_jiffies + NEXT_TIMER_MAX_DELTA;
+	clk = base->timer_jiffies;
+	for (lvl = 0; lvl < LVL_DEPTH; lvl++, offset += LVL_SIZE) {
+		int pos = next_pending_bucket(base, offset, clk & LVL_MASK,
+					      deferrable);
+
+		if (pos >= 0) {
+			unsigned long tmp = clk + (unsigned long) pos;
 
-		if (index)
-			timer_jiffies += TVN_SIZE - index;
-		timer_jiffies >>= TVN_BITS;
+			tmp <<= LVL_SHIFT(lvl);
+			if (time_before(tmp, next))
+				next = tmp;
+		}
+		/*
+		 * Clock for the next level. If the current level clock lower
+		 * bits are zero, we look at the next level as is. If not we
+		 * need to advance it by one because that's going to be the
+		 * next expiring bucket in that level. base->timer_jiffies is
+		 * the next expiring jiffie. So in case of:
+		 *
+		 * LVL5 LVL4 LVL3 LVL2 LVL1 LVL0
+		 *  0    0    0    0    0    0
+		 *
+		 * we have to look at all levels @index 0. With
+		 *
+		 * LVL5 LVL4 LVL3 LVL2 LVL1 LVL0
+		 *  0    0    0    0    0    2
+		 *
+		 * LVL0 has the next expiring bucket @index 2. The upper
+		 * levels have the next expiring bucket @index 1.
+		 *
+		 * In case that the propagation wraps the next level the same
+		 * rules apply:
+		 *
+		 * LVL5 LVL4 LVL3 LVL2 LVL1 LVL0
+		 *  0    0    0    0    F    2
+		 *
+		 * So after looking at LVL0 we get:
+		 *
+		 * LVL5 LVL4 LVL3 LVL2 LVL1
+		 *  0    0    0    1    0
+		 *
+		 * So no propagation from LVL1 to LVL2 because that happened
+		 * with the add already, but then we need to propagate further
+		 * from LVL2 to LVL3.
+		 *
+		 * So the simple check whether the lower bits of the current
+		 * level are 0 or not is sufficient for all cases.
+		 */
+		adj = clk & LVL_CLK_MASK ? 1 : 0;
+		clk >>= LVL_CLK_SHIFT;
+		clk += adj;
 	}
-	return expires;
+	return next;
+}
+
+/*
+ * After a NO_HZ idle period base->timer_jiffies lags behind jiffies
+ * until __run_timers() has caught up. A timer queued meanwhile would
+ * get its level from the inflated distance and land in a too coarse
+ * bucket, so move the wheel clock up to jiffies first - but never past
+ * the first pending bucket, deferrable timers included, which would
+ * then not be collected before the level wraps.
+ */
+static void forward_timer_base(struct tvec_base *base)
+{
+	unsigned long jnow = jiffies;
+
+	/* Nothing to gain unless the clock is more than a tick behind */
+	if ((long)(jnow - base->timer_jiffies) < 2)
+		return;
+
+	if (time_before_eq(base->next_expiry, base->timer_jiffies))
+		base->next_expiry = __next_timer_interrupt(base, true);
+
+	if (time_after(base->next_expiry, jnow))
+		base->timer_jiffies = jnow;
+	else
+		base->timer_jiffies = base->next_expiry;
 }
 
 /*
@@ -1175,7 +1448,7 @@ unsigned long get_next_timer_interrupt(unsigned long now)
 
 	spin_lock(&base->lock);
 	if (time_before_eq(base->next_timer, base->timer_jiffies))
-		base->next_timer = __next_timer_interrupt(base);
+		base->next_timer = __next_timer_interrupt(base, false);
 	expires = base->next_timer;
 	spin_unlock(&base->lock);
 
@@ -1553,17 +1826,13 @@ static int __cpuinit init_timers_cpu(int cpu)
 
 	spin_lock_init(&base->lock);
 
-	for (j = 0; j < TVN_SIZE; j++) {
-		INIT_LIST_HEAD(base->tv5.vec + j);
-		INIT_LIST_HEAD(base->tv4.vec + j);
-		INIT_LIST_HEAD(base->tv3.vec + j);
-		INIT_LIST_HEAD(base->tv2.vec + j);
-	}
-	for (j = 0; j < TVR_SIZE; j++)
-		INIT_LIST_HEAD(base->tv1.vec + j);
+	for (j = 0; j < WHEEL_SIZE; j++)
+		INIT_LIST_HEAD(base->vectors + j);
+	bitmap_zero(base->pending_map, WHEEL_SIZE);
 
 	base->timer_jiffies = jiffies;
 	base->next_timer = base->timer_jiffies;
+	base->next_expiry = base->timer_jiffies;
 	return 0;
 }
 
@@ -1601,14 +1870,10 @@ static void __cpuinit migrate_timers(int cpu)
 
 	BUG_ON(old_base->running_timer);
 
-	for (i = 0; i < TVR_SIZE; i++)
-		migrate_timer_list(new_base, old_base->tv1.vec + i);
-	for (i = 0; i < TVN_SIZE; i++) {
-		migrate_timer_list(new_base, old_base->tv2.vec + i);
-		migrate_timer_list(new_base, old_base->tv3.vec + i);
-		migrate_timer_list(new_base, old_base->tv4.vec + i);
-		migrate_timer_list(new_base, old_base->tv5.vec + i);
-	}
+	forward_timer_base(new_base);
+	for (i = 0; i < WHEEL_SIZE; i++)
+		migrate_timer_list(new_base, old_base->vectors + i);
+	bitmap_zero(old_base->pending_map, WHEEL_SIZE);
 
 	spin_unlock(&old_base->lock);
 	spin_unlock_irq(&new_base->lock);
@@ -1655,6 +1920,56 @@ void __init init_timers(void)
 	open_softirq(TIMER_SOFTIRQ, run_timer_softirq);
 }
 
+#ifdef CONFIG_TIMER_STATS
+static int timer_wheel_show(struct seq_file *m, void *v)
+{
+	struct tvec_stats *st;
+	int cpu, lvl;
+
+	seq_puts(m, "Timer Wheel Stats Version: v0.1\n");
+	seq_printf(m, "levels: %d, buckets/level: %lu, clock shift: %d\n",
+		   LVL_DEPTH, LVL_SIZE, LVL_CLK_SHIFT);
+	for_each_online_cpu(cpu) {
+		st = &per_cpu(tvec_bases, cpu)->stats;
+		seq_printf(m, "cpu: %d\n", cpu);
+		seq_printf(m, " runs:       %lu\n", st->runs);
+		seq_printf(m, " ticks:      %lu\n", st->ticks);
+		seq_printf(m, " buckets:    %lu\n", st->buckets);
+		seq_printf(m, " expired:    %lu\n", st->expired);
+		seq_printf(m, " max_batch:  %lu\n", st->max_batch);
+		seq_printf(m, " collect_ns: %llu\n",
+			   (unsigned long long)st->collect_ns);
+		seq_printf(m, " expire_ns:  %llu\n",
+			   (unsigned long long)st->expire_ns);
+		seq_puts(m, " enqueued:  ");
+		for (lvl = 0; lvl < LVL_DEPTH; lvl++)
+			seq_printf(m, " %lu", st->enqueued[lvl]);
+		seq_putc(m, '\n');
+	}
+	return 0;
+}
+
+static int timer_wheel_open(struct inode *inode, struct file *filp)
+{
+	return single_open(filp, timer_wheel_show, NULL);
+}
+
+static const struct file_operations timer_wheel_fops = {
+	.open		= timer_wheel_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init init_timer_wheel_procfs(void)
+{
+	if (!proc_create("timer_wheel", 0444, NULL, &timer_wheel_fops))
+		return -ENOMEM;
+	return 0;
+}
+__initcall(init_timer_wheel_procfs);
+#endif
+
 /**
  * msleep - sleep safely even with waitqueue interruptions
  * @msecs: Time in milliseconds to sleep for
@@ -24,6 +24,9 @@ void __init_rwsem(struct rw_semaphore *sem, const char *name,
 	sem->count = RWSEM_UNLOCKED_VALUE;
 	spin_lock_init(&sem->wait_lock);
 	INIT_LIST_HEAD(&sem->wait_list);
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+	sem->owner = NULL;
+#endif
 }
 
 EXPORT_SYMBOL(__init_rwsem);
@@ -199,6 +202,70 @@ rwsem_down_read_failed(struct rw_semaphore *sem)
 	return sem;
 }
 
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+/*
+ * take the write lock if nobody is active, even if there are processes
+ * queued on it - this is where a spinning writer steals the lock
+ */
+static inline int rwsem_try_write_lock_unqueued(struct rw_semaphore *sem)
+{
+	signed long count = sem->count, old;
+
+	while (!(count & RWSEM_ACTIVE_MASK)) {
+		old = cmpxchg(&sem->count, count,
+			      count + RWSEM_ACTIVE_WRITE_BIAS);
+		if (old == count)
+			return 1;
+		count = old;
+	}
+	return 0;
+}
+
+/*
+ * spin for the write lock while the writer holding it is running
+ * - readers are not tracked, so don't spin on a read-held semaphore
+ * - returns 1 with the write lock held, 0 if we should go to sleep
+ */
+static int rwsem_optimistic_spin(struct rw_semaphore *sem)
+{
+	struct thread_info *owner;
+	int taken = 0;
+
+	preempt_disable();
+	for (;;) {
+		owner = ACCESS_ONCE(sem->owner);
+		if (owner == RWSEM_READER_OWNED)
+			break;
+
+		/*
+		 * If there's an owner, wait for it to either
+		 * release the lock or go to sleep.
+		 */
+		if (owner && !rwsem_spin_on_owner(sem, owner))
+			break;
+
+		if (rwsem_try_write_lock_unqueued(sem)) {
+			taken = 1;
+			break;
+		}
+
+		/*
+		 * When there's no owner, we might have preempted between the
+		 * owner acquiring the lock and setting the owner field. If
+		 * we're an RT task that will live-lock because we won't let
+		 * the owner complete.
+		 */
+		if (!owner && (need_resched() || rt_task(current)))
+			break;
+
+		cpu_relax();
+	}
+	preempt_enable();
+
+	return taken;
+}
+#endif
+
 /*
  * wait for the write lock to be granted
  */
@@ -206,9 +273,30 @@ asmregparm struct rw_semaphore __sched *
 rwsem_down_write_failed(struct rw_semaphore *sem)
 {
 	struct rwsem_waiter waiter;
+	signed long adjustment = -RWSEM_ACTIVE_BIAS;
+
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+	if (ACCESS_ONCE(sem->owner) != RWSEM_READER_OWNED) {
+		signed long count;
+
+		/* withdraw our write bias completely while spinning - if
+		 * that leaves only sleepers on the semaphore, they were
+		 * passed over by up_xxxx() because of us, so wake them
+		 */
+		count = rwsem_atomic_update(-RWSEM_ACTIVE_WRITE_BIAS, sem);
+		if (count && !(count & RWSEM_ACTIVE_MASK))
+			rwsem_wake(sem);
+
+		if (rwsem_optimistic_spin(sem))
+			return sem;
+
+		/* queue with a waiting bias of our own */
+		adjustment = RWSEM_WAITING_BIAS;
+	}
+#endif
 
 	waiter.flags = RWSEM_WAITING_FOR_WRITE;
-	rwsem_down_failed_common(sem, &waiter, -RWSEM_ACTIVE_BIAS);
+	rwsem_down_failed_common(sem, &waiter, adjustment);
 
 	return sem;
 }
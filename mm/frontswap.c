@@ -0,0 +1,194 @@
+/*
+ * Frontswap: a hook in front of the swap devices
+ *
+ * A backend registered with frontswap_register_ops() gets the first
+ * chance at every page swap_writepage() is about to write: if it keeps
+ * the page, no I/O is issued, and swap_readpage() later gets the page
+ * back from the backend instead of the device.  The swap slot is still
+ * allocated as usual and serves as the key, so a backend may refuse any
+ * page (when it is full, say) and the page simply goes to the device.
+ *
+ * Which slots are held by the backend is recorded in a bitmap hung off
+ * each swap_info_struct, allocated at swapon time.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <linux/mm.h>
+#include <linux/mman.h>
+#include <linux/swap.h>
+#include <linux/swapops.h>
+#include <linux/swapfile.h>
+#include <linux/frontswap.h>
+#include <linux/module.h>
+#include <linux/debugfs.h>
+
+/*
+ * The backend: set once, by frontswap_register_ops().
+ */
+static struct frontswap_ops frontswap_ops __read_mostly;
+
+/*
+ * Nonzero once a backend has been registered; swap devices enabled
+ * from then on get a frontswap_map.
+ */
+int frontswap_enabled __read_mostly;
+EXPORT_SYMBOL(frontswap_enabled);
+
+/*
+ * Counters exported in debugfs.  They are not updated atomically, as
+ * they are only meant to give an idea of how well the backend does.
+ */
+static u64 frontswap_loads;
+static u64 frontswap_misses;
+static u64 frontswap_succ_stores;
+static u64 frontswap_failed_stores;
+static u64 frontswap_invalidates;
+
+/*
+ * Register a backend, returning the previous one.
+ */
+struct frontswap_ops frontswap_register_ops(struct frontswap_ops *ops)
+{
+	struct frontswap_ops old = frontswap_ops;
+
+	frontswap_ops = *ops;
+	frontswap_enabled = 1;
+	return old;
+}
+EXPORT_SYMBOL(frontswap_register_ops);
+
+/*
+ * Called at swapon time, once the swap device has its frontswap_map.
+ */
+void __frontswap_init(unsigned type)
+{
+	struct swap_info_struct *sis = swap_info[type];
+
+	BUG_ON(sis == NULL);
+	if (sis->frontswap_map == NULL)
+		return;
+	frontswap_ops.init(type);
+}
+EXPORT_SYMBOL(__frontswap_init);
+
+/*
+ * Offer the page to the backend.  If the slot was already held by the
+ * backend (the page was redirtied in the swap cache), the old copy is
+ * replaced on success and dropped on failure, so that a stale copy can
+ * never be loaded back.
+ */
+int __frontswap_store(struct page *page)
+{
+	int ret = -1, dup = 0;
+	swp_entry_t entry = { .val = page_private(page), };
+	int type = swp_type(entry);
+	struct swap_info_struct *sis = swap_info[type];
+	pgoff_t offset = swp_offset(entry);
+
+	BUG_ON(!PageLocked(page));
+	BUG_ON(sis == NULL);
+	if (sis->frontswap_map == NULL)
+		return ret;
+	if (frontswap_test(sis, offset))
+		dup = 1;
+	ret = frontswap_ops.store(type, offset, page);
+	if (ret == 0) {
+		frontswap_succ_stores++;
+		if (!dup) {
+			set_bit(offset, sis->frontswap_map);
+			atomic_inc(&sis->frontswap_pages);
+		}
+	} else {
+		frontswap_failed_stores++;
+		if (dup) {
+			frontswap_ops.invalidate_page(type, offset);
+			clear_bit(offset, sis->frontswap_map);
+			atomic_dec(&sis->frontswap_pages);
+		}
+	}
+	return ret;
+}
+EXPORT_SYMBOL(__frontswap_store);
+
+/*
+ * Fill the page in from the backend if it holds the slot.
+ */
+int __frontswap_load(struct page *page)
+{
+	int ret = -1;
+	swp_entry_t entry = { .val = page_private(page), };
+	int type = swp_type(entry);
+	struct swap_info_struct *sis = swap_info[type];
+	pgoff_t offset = swp_offset(entry);
+
+	BUG_ON(!PageLocked(page));
+	BUG_ON(sis == NULL);
+	if (frontswap_test(sis, offset))
+		ret = frontswap_ops.load(type, offset, page);
+	if (ret == 0)
+		frontswap_loads++;
+	else
+		frontswap_misses++;
+	return ret;
+}
+EXPORT_SYMBOL(__frontswap_load);
+
+/*
+ * The swap slot is being freed: drop the backend's copy, if any.
+ * Called with swap_lock held.
+ */
+void __frontswap_invalidate_page(unsigned type, pgoff_t offset)
+{
+	struct swap_info_struct *sis = swap_info[type];
+
+	BUG_ON(sis == NULL);
+	if (frontswap_test(sis, offset)) {
+		frontswap_ops.invalidate_page(type, offset);
+		clear_bit(offset, sis->frontswap_map);
+		atomic_dec(&sis->frontswap_pages);
+		frontswap_invalidates++;
+	}
+}
+EXPORT_SYMBOL(__frontswap_invalidate_page);
+
+/*
+ * The swap device is going away: drop everything the backend holds
+ * for it.  Called with swap_lock held.
+ */
+void __frontswap_invalidate_area(unsigned type)
+{
+	struct swap_info_struct *sis = swap_info[type];
+
+	BUG_ON(sis == NULL);
+	if (sis->frontswap_map == NULL)
+		return;
+	frontswap_ops.invalidate_area(type);
+	atomic_set(&sis->frontswap_pages, 0);
+	memset(sis->frontswap_map, 0, BITS_TO_LONGS(sis->max) * sizeof(long));
+}
+EXPORT_SYMBOL(__frontswap_invalidate_area);
+
+static int __init init_frontswap(void)
+{
+#ifdef CONFIG_DEBUG_FS
+	struct dentry *root = debugfs_create_dir("frontswap", NULL);
+
+	if (root == NULL)
+		return -ENXIO;
+	debugfs_create_u64("loads", S_IRUGO, root, &frontswap_loads);
+	debugfs_create_u64("misses", S_IRUGO, root, &frontswap_misses);
+	debugfs_create_u64("succ_stores", S_IRUGO, root,
+			   &frontswap_succ_stores);
+	debugfs_create_u64("failed_stores", S_IRUGO, root,
+			   &frontswap_failed_stores);
+	debugfs_create_u64("invalidates", S_IRUGO, root,
+			   &frontswap_invalidates);
+#endif
+	return 0;
+}
+
+module_init(init_frontswap);
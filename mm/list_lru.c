@@ -0,0 +1,97 @@
+/*
+ * Per-node LRU lists, see include/linux/list_lru.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/list_lru.h>
+
+/*
+ * The node the object at @item was allocated on.
+ */
+int list_lru_item_nid(void *item)
+{
+	return page_to_nid(virt_to_page(item));
+}
+EXPORT_SYMBOL_GPL(list_lru_item_nid);
+
+/*
+ * Account @item to its node.  The caller puts it on a list: the node's
+ * LRU normally, or a private list of objects it is about to dispose of,
+ * which still count as being on the LRU until they are taken off.
+ */
+void list_lru_account_add(struct list_lru *lru, struct list_head *item)
+{
+	lru->node[list_lru_item_nid(item)].nr_items++;
+	lru->nr_items++;
+}
+EXPORT_SYMBOL_GPL(list_lru_account_add);
+
+void list_lru_account_del(struct list_lru *lru, struct list_head *item)
+{
+	lru->node[list_lru_item_nid(item)].nr_items--;
+	lru->nr_items--;
+}
+EXPORT_SYMBOL_GPL(list_lru_account_del);
+
+/*
+ * Add @item at the head of its node's list, unless it is on a list
+ * already.  Returns true if it was added.
+ */
+bool list_lru_add(struct list_lru *lru, struct list_head *item)
+{
+	int nid = list_lru_item_nid(item);
+
+	if (!list_empty(item))
+		return false;
+	list_add(item, &lru->node[nid].list);
+	lru->node[nid].nr_items++;
+	lru->nr_items++;
+	return true;
+}
+EXPORT_SYMBOL_GPL(list_lru_add);
+
+/*
+ * Take @item off whatever list it is on, if any.  Returns true if it
+ * was on one.
+ */
+bool list_lru_del(struct list_lru *lru, struct list_head *item)
+{
+	if (list_empty(item))
+		return false;
+	list_del_init(item);
+	list_lru_account_del(lru, item);
+	return true;
+}
+EXPORT_SYMBOL_GPL(list_lru_del);
+
+int list_lru_init(struct list_lru *lru)
+{
+	int i;
+
+	lru->node = kmalloc(nr_node_ids * sizeof(*lru->node), GFP_KERNEL);
+	if (!lru->node)
+		return -ENOMEM;
+
+	for (i = 0; i < nr_node_ids; i++) {
+		INIT_LIST_HEAD(&lru->node[i].list);
+		lru->node[i].nr_items = 0;
+	}
+	lru->nr_items = 0;
+	return 0;
+}
+EXPORT_SYMBOL_GPL(list_lru_init);
+
+void list_lru_destroy(struct list_lru *lru)
+{
+	WARN_ON(lru->nr_items);
+	kfree(lru->node);
+	lru->node = NULL;
+}
+EXPORT_SYMBOL_GPL(list_lru_destroy);
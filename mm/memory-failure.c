@@ -45,6 +45,7 @@
 #include <linux/page-isolation.h>
 #include <linux/suspend.h>
 #include <linux/slab.h>
+#include <linux/hugetlb.h>
 #include "internal.h"
 
 int sysctl_memory_failure_early_kill __read_mostly = 0;
@@ -231,8 +232,14 @@ void shake_page(struct page *p, int access)
 	 */
 	if (access) {
 		int nr;
+		struct shrink_control shrink = {
+			.gfp_mask = GFP_KERNEL,
+		};
+
+		/* the page's node is the only one worth shrinking */
+		node_set(page_to_nid(p), shrink.nodes_to_scan);
 		do {
-			nr = shrink_slab(1000, GFP_KERNEL, 1000);
+			nr = shrink_slab(&shrink, 1000, 1000);
 			if (page_count(p) == 0)
 				break;
 		} while (nr > 10);
@@ -963,6 +970,26 @@ int __memory_failure(unsigned long pfn, int trapno, int flags)
 		}
 	}
 
+	/*
+	 * A transparent hugepage is split first, so that only the
+	 * poisoned subpage has to be isolated below.
+	 */
+	if (PageTransCompound(p) && !PageHuge(p)) {
+		struct page *hpage = compound_head(p);
+
+		if (!PageAnon(hpage) || split_huge_page(hpage)) {
+			action_result(pfn, "transparent hugepage", IGNORED);
+			if (!(flags & MF_COUNT_INCREASED))
+				put_page(hpage);
+			return -EBUSY;
+		}
+		/* move our reference from the old head to the subpage */
+		if (!(flags & MF_COUNT_INCREASED) && hpage != p) {
+			get_page(p);
+			put_page(hpage);
+		}
+	}
+
 	/*
 	 * We ignore non-LRU pages for good reasons.
 	 * - PG_locked is only well defined for LRU pages and a few others
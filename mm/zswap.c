@@ -0,0 +1,524 @@
+/*
+ * zswap.c - compressed cache for swap pages
+ *
+ * zswap is a frontswap backend: pages on their way to a swap device are
+ * compressed with LZO and kept in a dynamically sized pool of RAM
+ * managed by zbud, which packs two compressed pages into each page of
+ * the pool.  Swapping them back in is then a decompression rather than
+ * a disk read.  Once the pool reaches max_pool_percent of RAM, or a
+ * page compresses too poorly to be worth keeping, the page is refused
+ * and goes to the swap device as usual.
+ *
+ * zswap is off unless booted with zswap.enabled=1.  Statistics are in
+ * debugfs, under zswap/.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <linux/module.h>
+#include <linux/highmem.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/types.h>
+#include <linux/rbtree.h>
+#include <linux/swap.h>
+#include <linux/lzo.h>
+#include <linux/frontswap.h>
+#include <linux/zbud.h>
+#include <linux/debugfs.h>
+
+/*********************************
+* statistics
+**********************************/
+/* Number of pages currently stored in zswap */
+static atomic_long_t zswap_stored_pages = ATOMIC_LONG_INIT(0);
+/* Number of compressed bytes currently stored in zswap */
+static atomic_long_t zswap_compressed_bytes = ATOMIC_LONG_INIT(0);
+/* Number of pages the pool currently takes up */
+static u64 zswap_pool_pages;
+
+/*
+ * The statistics below are not protected from concurrent access for
+ * performance reasons so they may not be a 100% accurate.  However,
+ * they do provide useful information on roughly how many times a
+ * certain event is occurring.
+*/
+/* Store failed because the pool was full */
+static u64 zswap_pool_limit_hit;
+/* Store failed because the zbud allocator could not get a page */
+static u64 zswap_reject_alloc_fail;
+/* Store failed because the entry metadata could not be allocated */
+static u64 zswap_reject_kmemcache_fail;
+/* Store failed because the compressed page was too big for zbud */
+static u64 zswap_reject_compress_poor;
+/* Compressor returned an error */
+static u64 zswap_reject_compress_fail;
+/* Store replaced an entry already in the tree */
+static u64 zswap_duplicate_entry;
+
+/*********************************
+* tunables
+**********************************/
+/* Enable/disable zswap (disabled by default, fixed at boot for now) */
+static int zswap_enabled;
+module_param_named(enabled, zswap_enabled, bool, 0444);
+
+/* The maximum percentage of memory that the compressed pool can occupy */
+static unsigned int zswap_max_pool_percent = 20;
+module_param_named(max_pool_percent, zswap_max_pool_percent, uint, 0644);
+
+/* zbud pages are only ever taken when they come easily */
+#define ZSWAP_GFP	(__GFP_NORETRY | __GFP_NOWARN | __GFP_NOMEMALLOC)
+
+static struct zbud_pool *zswap_pool;
+
+/*********************************
+* compression buffers
+**********************************/
+/*
+ * One LZO work area and one destination buffer per cpu, used with
+ * preemption disabled.  The destination is two pages so that even the
+ * worst case expansion of an incompressible page fits.
+ */
+static DEFINE_PER_CPU(void *, zswap_wrkmem);
+static DEFINE_PER_CPU(u8 *, zswap_dstmem);
+
+static void zswap_free_percpu(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		kfree(per_cpu(zswap_wrkmem, cpu));
+		free_pages((unsigned long)per_cpu(zswap_dstmem, cpu), 1);
+		per_cpu(zswap_wrkmem, cpu) = NULL;
+		per_cpu(zswap_dstmem, cpu) = NULL;
+	}
+}
+
+static int __init zswap_alloc_percpu(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		per_cpu(zswap_wrkmem, cpu) = kmalloc(LZO1X_MEM_COMPRESS,
+						     GFP_KERNEL);
+		per_cpu(zswap_dstmem, cpu) =
+			(u8 *)__get_free_pages(GFP_KERNEL, 1);
+		if (!per_cpu(zswap_wrkmem, cpu) ||
+		    !per_cpu(zswap_dstmem, cpu)) {
+			zswap_free_percpu();
+			return -ENOMEM;
+		}
+	}
+	return 0;
+}
+
+/*********************************
+* data structures
+**********************************/
+/*
+ * struct zswap_entry
+ *
+ * This structure contains the metadata for tracking a single compressed
+ * page within zswap.
+ *
+ * rbnode - links the entry into red-black tree for the appropriate swap type
+ * refcount - the number of outstanding reference to the entry.  The tree
+ *            holds one; a load in progress holds another, so that the
+ *            entry outlives an invalidation racing with the decompression.
+ * offset - the swap offset for the entry.  Index into the red-black tree.
+ * handle - zbud allocation handle that stores the compressed page data
+ * length - the length in bytes of the compressed page data
+ */
+struct zswap_entry {
+	struct rb_node rbnode;
+	pgoff_t offset;
+	int refcount;
+	unsigned int length;
+	unsigned long handle;
+};
+
+/*
+ * The tree lock in the zswap_tree struct protects a few things:
+ * - the rbtree
+ * - the refcount field of each entry in the tree
+ */
+struct zswap_tree {
+	struct rb_root rbroot;
+	spinlock_t lock;
+};
+
+static struct zswap_tree zswap_trees[MAX_SWAPFILES];
+
+static struct kmem_cache *zswap_entry_cache;
+
+static struct zswap_entry *zswap_entry_cache_alloc(gfp_t gfp)
+{
+	struct zswap_entry *entry;
+
+	entry = kmem_cache_alloc(zswap_entry_cache, gfp);
+	if (!entry)
+		return NULL;
+	entry->refcount = 1;
+	RB_CLEAR_NODE(&entry->rbnode);
+	return entry;
+}
+
+static void zswap_entry_cache_free(struct zswap_entry *entry)
+{
+	kmem_cache_free(zswap_entry_cache, entry);
+}
+
+static struct zswap_entry *zswap_rb_search(struct rb_root *root,
+					   pgoff_t offset)
+{
+	struct rb_node *node = root->rb_node;
+	struct zswap_entry *entry;
+
+	while (node) {
+		entry = rb_entry(node, struct zswap_entry, rbnode);
+		if (entry->offset > offset)
+			node = node->rb_left;
+		else if (entry->offset < offset)
+			node = node->rb_right;
+		else
+			return entry;
+	}
+	return NULL;
+}
+
+/*
+ * In the case that a entry with the same offset is found, a pointer to
+ * the existing entry is stored in dupentry and the function returns -EEXIST
+ */
+static int zswap_rb_insert(struct rb_root *root, struct zswap_entry *entry,
+			   struct zswap_entry **dupentry)
+{
+	struct rb_node **link = &root->rb_node, *parent = NULL;
+	struct zswap_entry *myentry;
+
+	while (*link) {
+		parent = *link;
+		myentry = rb_entry(parent, struct zswap_entry, rbnode);
+		if (myentry->offset > entry->offset)
+			link = &(*link)->rb_left;
+		else if (myentry->offset < entry->offset)
+			link = &(*link)->rb_right;
+		else {
+			*dupentry = myentry;
+			return -EEXIST;
+		}
+	}
+	rb_link_node(&entry->rbnode, parent, link);
+	rb_insert_color(&entry->rbnode, root);
+	return 0;
+}
+
+/*
+ * Carries out the common pattern of freeing and entry's zbud allocation,
+ * freeing the entry itself, and updating the number of stored pages.
+ */
+static void zswap_free_entry(struct zswap_entry *entry)
+{
+	zbud_free(zswap_pool, entry->handle);
+	atomic_long_dec(&zswap_stored_pages);
+	atomic_long_sub(entry->length, &zswap_compressed_bytes);
+	zswap_entry_cache_free(entry);
+	zswap_pool_pages = zbud_get_pool_size(zswap_pool);
+}
+
+/* caller must hold the tree lock; frees the entry on the last put */
+static void zswap_entry_put(struct zswap_entry *entry)
+{
+	if (--entry->refcount == 0)
+		zswap_free_entry(entry);
+}
+
+static bool zswap_is_full(void)
+{
+	return totalram_pages * zswap_max_pool_percent / 100 <
+		zbud_get_pool_size(zswap_pool);
+}
+
+/*********************************
+* frontswap hooks
+**********************************/
+/* attempts to compress and store an single page */
+static int zswap_frontswap_store(unsigned type, pgoff_t offset,
+				 struct page *page)
+{
+	struct zswap_tree *tree = &zswap_trees[type];
+	struct zswap_entry *entry, *dupentry;
+	size_t dlen;
+	unsigned long handle;
+	void *wrkmem;
+	u8 *src, *dst, *buf;
+	int ret;
+
+	if (zswap_is_full()) {
+		zswap_pool_limit_hit++;
+		return -ENOMEM;
+	}
+
+	/* allocate entry */
+	entry = zswap_entry_cache_alloc(GFP_NOIO);
+	if (!entry) {
+		zswap_reject_kmemcache_fail++;
+		return -ENOMEM;
+	}
+
+	/* compress */
+	dst = get_cpu_var(zswap_dstmem);
+	wrkmem = __get_cpu_var(zswap_wrkmem);
+	src = kmap_atomic(page, KM_USER0);
+	ret = lzo1x_1_compress(src, PAGE_SIZE, dst, &dlen, wrkmem);
+	kunmap_atomic(src, KM_USER0);
+	if (ret != LZO_E_OK) {
+		zswap_reject_compress_fail++;
+		ret = -EINVAL;
+		goto putcpu;
+	}
+
+	/* store */
+	ret = zbud_alloc(zswap_pool, dlen, ZSWAP_GFP, &handle);
+	if (ret == -ENOSPC) {
+		zswap_reject_compress_poor++;
+		goto putcpu;
+	}
+	if (ret) {
+		zswap_reject_alloc_fail++;
+		goto putcpu;
+	}
+	buf = zbud_map(zswap_pool, handle);
+	memcpy(buf, dst, dlen);
+	zbud_unmap(zswap_pool, handle);
+	put_cpu_var(zswap_dstmem);
+
+	/* populate entry */
+	entry->offset = offset;
+	entry->handle = handle;
+	entry->length = dlen;
+
+	/* map */
+	spin_lock(&tree->lock);
+	do {
+		ret = zswap_rb_insert(&tree->rbroot, entry, &dupentry);
+		if (ret == -EEXIST) {
+			zswap_duplicate_entry++;
+			/* remove from rbtree */
+			rb_erase(&dupentry->rbnode, &tree->rbroot);
+			zswap_entry_put(dupentry);
+		}
+	} while (ret == -EEXIST);
+	spin_unlock(&tree->lock);
+
+	/* update stats */
+	atomic_long_inc(&zswap_stored_pages);
+	atomic_long_add(dlen, &zswap_compressed_bytes);
+	zswap_pool_pages = zbud_get_pool_size(zswap_pool);
+
+	return 0;
+
+putcpu:
+	put_cpu_var(zswap_dstmem);
+	zswap_entry_cache_free(entry);
+	return ret;
+}
+
+/*
+ * returns 0 if the page was successfully decompressed
+ * return -1 on entry not found or error
+*/
+static int zswap_frontswap_load(unsigned type, pgoff_t offset,
+				struct page *page)
+{
+	struct zswap_tree *tree = &zswap_trees[type];
+	struct zswap_entry *entry;
+	size_t dlen = PAGE_SIZE;
+	u8 *src, *dst;
+	int ret;
+
+	/* find */
+	spin_lock(&tree->lock);
+	entry = zswap_rb_search(&tree->rbroot, offset);
+	if (!entry) {
+		/* entry was invalidated */
+		spin_unlock(&tree->lock);
+		return -1;
+	}
+	entry->refcount++;
+	spin_unlock(&tree->lock);
+
+	/* decompress */
+	src = zbud_map(zswap_pool, entry->handle);
+	dst = kmap_atomic(page, KM_USER0);
+	ret = lzo1x_decompress_safe(src, entry->length, dst, &dlen);
+	kunmap_atomic(dst, KM_USER0);
+	zbud_unmap(zswap_pool, entry->handle);
+	BUG_ON(ret != LZO_E_OK || dlen != PAGE_SIZE);
+
+	spin_lock(&tree->lock);
+	zswap_entry_put(entry);
+	spin_unlock(&tree->lock);
+
+	return 0;
+}
+
+/* frees an entry in zswap */
+static void zswap_frontswap_invalidate_page(unsigned type, pgoff_t offset)
+{
+	struct zswap_tree *tree = &zswap_trees[type];
+	struct zswap_entry *entry;
+
+	/* find */
+	spin_lock(&tree->lock);
+	entry = zswap_rb_search(&tree->rbroot, offset);
+	if (!entry) {
+		/* entry was already invalidated */
+		spin_unlock(&tree->lock);
+		return;
+	}
+
+	/* remove from rbtree and drop the tree's reference */
+	rb_erase(&entry->rbnode, &tree->rbroot);
+	zswap_entry_put(entry);
+
+	spin_unlock(&tree->lock);
+}
+
+/* frees all zswap entries for the given swap type */
+static void zswap_frontswap_invalidate_area(unsigned type)
+{
+	struct zswap_tree *tree = &zswap_trees[type];
+	struct rb_node *node;
+	struct zswap_entry *entry;
+
+	spin_lock(&tree->lock);
+	while ((node = rb_first(&tree->rbroot))) {
+		entry = rb_entry(node, struct zswap_entry, rbnode);
+		rb_erase(&entry->rbnode, &tree->rbroot);
+		zswap_free_entry(entry);
+	}
+	tree->rbroot = RB_ROOT;
+	spin_unlock(&tree->lock);
+}
+
+static void zswap_frontswap_init(unsigned type)
+{
+	struct zswap_tree *tree = &zswap_trees[type];
+
+	spin_lock(&tree->lock);
+	WARN_ON(!RB_EMPTY_ROOT(&tree->rbroot));
+	tree->rbroot = RB_ROOT;
+	spin_unlock(&tree->lock);
+}
+
+static struct frontswap_ops zswap_frontswap_ops = {
+	.store = zswap_frontswap_store,
+	.load = zswap_frontswap_load,
+	.invalidate_page = zswap_frontswap_invalidate_page,
+	.invalidate_area = zswap_frontswap_invalidate_area,
+	.init = zswap_frontswap_init
+};
+
+/*********************************
+* debugfs functions
+**********************************/
+#ifdef CONFIG_DEBUG_FS
+
+static struct dentry *zswap_debugfs_root;
+
+static int zswap_atomic_long_get(void *data, u64 *val)
+{
+	*val = atomic_long_read((atomic_long_t *)data);
+	return 0;
+}
+DEFINE_SIMPLE_ATTRIBUTE(zswap_atomic_long_fops, zswap_atomic_long_get, NULL,
+			"%llu\n");
+
+static int __init zswap_debugfs_init(void)
+{
+	zswap_debugfs_root = debugfs_create_dir("zswap", NULL);
+	if (!zswap_debugfs_root)
+		return -ENOMEM;
+
+	debugfs_create_u64("pool_limit_hit", S_IRUGO,
+			zswap_debugfs_root, &zswap_pool_limit_hit);
+	debugfs_create_u64("reject_alloc_fail", S_IRUGO,
+			zswap_debugfs_root, &zswap_reject_alloc_fail);
+	debugfs_create_u64("reject_kmemcache_fail", S_IRUGO,
+			zswap_debugfs_root, &zswap_reject_kmemcache_fail);
+	debugfs_create_u64("reject_compress_poor", S_IRUGO,
+			zswap_debugfs_root, &zswap_reject_compress_poor);
+	debugfs_create_u64("reject_compress_fail", S_IRUGO,
+			zswap_debugfs_root, &zswap_reject_compress_fail);
+	debugfs_create_u64("duplicate_entry", S_IRUGO,
+			zswap_debugfs_root, &zswap_duplicate_entry);
+	debugfs_create_u64("pool_pages", S_IRUGO,
+			zswap_debugfs_root, &zswap_pool_pages);
+	debugfs_create_file("stored_pages", S_IRUGO, zswap_debugfs_root,
+			&zswap_stored_pages, &zswap_atomic_long_fops);
+	debugfs_create_file("compressed_bytes", S_IRUGO, zswap_debugfs_root,
+			&zswap_compressed_bytes, &zswap_atomic_long_fops);
+
+	return 0;
+}
+#else
+static int __init zswap_debugfs_init(void)
+{
+	return 0;
+}
+#endif
+
+/*********************************
+* module init
+**********************************/
+static int __init init_zswap(void)
+{
+	int i;
+
+	if (!zswap_enabled)
+		return 0;
+
+	printk(KERN_INFO "zswap: loading zswap\n");
+
+	zswap_pool = zbud_create_pool(GFP_KERNEL);
+	if (!zswap_pool) {
+		printk(KERN_ERR "zswap: zbud pool creation failed\n");
+		goto error;
+	}
+	zswap_entry_cache = KMEM_CACHE(zswap_entry, 0);
+	if (!zswap_entry_cache) {
+		printk(KERN_ERR "zswap: entry cache creation failed\n");
+		goto cachefail;
+	}
+	if (zswap_alloc_percpu()) {
+		printk(KERN_ERR "zswap: per-cpu buffer allocation failed\n");
+		goto pcpufail;
+	}
+	for (i = 0; i < MAX_SWAPFILES; i++) {
+		zswap_trees[i].rbroot = RB_ROOT;
+		spin_lock_init(&zswap_trees[i].lock);
+	}
+
+	frontswap_register_ops(&zswap_frontswap_ops);
+	if (zswap_debugfs_init())
+		printk(KERN_WARNING "zswap: debugfs initialization failed\n");
+	return 0;
+
+pcpufail:
+	kmem_cache_destroy(zswap_entry_cache);
+cachefail:
+	zbud_destroy_pool(zswap_pool);
+error:
+	zswap_enabled = 0;
+	return -ENOMEM;
+}
+/* must be late so debugfs is up and frontswap is ready */
+late_initcall(init_zswap);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Compressed cache for swap pages");
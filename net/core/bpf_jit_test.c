@@ -0,0 +1,257 @@
+/*
+ * BPF JIT self test
+ *
+ * Compiles a set of socket filters with bpf_jit_compile() and checks
+ * that the generated code returns the same value as sk_run_filter()
+ * on a few test packets: a linear one, the same packet with its
+ * payload in a page fragment, and a truncated one.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/skbuff.h>
+#include <linux/filter.h>
+#include <linux/if_ether.h>
+#include <linux/in.h>
+#include <linux/slab.h>
+#include <linux/gfp.h>
+#include <linux/mm.h>
+
+/* tcpdump -dd 'ip and tcp dst port 22' */
+static struct sock_filter tcp_dport_22[] __initdata = {
+	BPF_STMT(BPF_LD|BPF_H|BPF_ABS, 12),
+	BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, ETH_P_IP, 0, 8),
+	BPF_STMT(BPF_LD|BPF_B|BPF_ABS, 23),
+	BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, IPPROTO_TCP, 0, 6),
+	BPF_STMT(BPF_LD|BPF_H|BPF_ABS, 20),
+	BPF_JUMP(BPF_JMP|BPF_JSET|BPF_K, 0x1fff, 4, 0),
+	BPF_STMT(BPF_LDX|BPF_B|BPF_MSH, 14),
+	BPF_STMT(BPF_LD|BPF_H|BPF_IND, 16),
+	BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, 22, 0, 1),
+	BPF_STMT(BPF_RET|BPF_K, 0xffff),
+	BPF_STMT(BPF_RET|BPF_K, 0),
+};
+
+static struct sock_filter alu_ops[] __initdata = {
+	BPF_STMT(BPF_LD|BPF_W|BPF_LEN, 0),
+	BPF_STMT(BPF_LDX|BPF_IMM, 3),
+	BPF_STMT(BPF_ALU|BPF_ADD|BPF_X, 0),
+	BPF_STMT(BPF_ALU|BPF_MUL|BPF_K, 1000),
+	BPF_STMT(BPF_ALU|BPF_SUB|BPF_K, 7),
+	BPF_STMT(BPF_ALU|BPF_DIV|BPF_X, 0),
+	BPF_STMT(BPF_ST, 1),
+	BPF_STMT(BPF_ALU|BPF_LSH|BPF_K, 3),
+	BPF_STMT(BPF_ALU|BPF_OR|BPF_K, 0x10000),
+	BPF_STMT(BPF_ALU|BPF_AND|BPF_K, 0xffffff0f),
+	BPF_STMT(BPF_ALU|BPF_RSH|BPF_X, 0),
+	BPF_STMT(BPF_ALU|BPF_NEG, 0),
+	BPF_STMT(BPF_ALU|BPF_DIV|BPF_K, 13),
+	BPF_STMT(BPF_LDX|BPF_MEM, 1),
+	BPF_STMT(BPF_ALU|BPF_SUB|BPF_X, 0),
+	BPF_STMT(BPF_RET|BPF_A, 0),
+};
+
+static struct sock_filter div_by_zero[] __initdata = {
+	BPF_STMT(BPF_LD|BPF_IMM, 42),
+	BPF_STMT(BPF_LDX|BPF_IMM, 0),
+	BPF_STMT(BPF_ALU|BPF_DIV|BPF_X, 0),
+	BPF_STMT(BPF_RET|BPF_K, 1),
+};
+
+static struct sock_filter load_tail[] __initdata = {
+	BPF_STMT(BPF_LD|BPF_W|BPF_LEN, 0),
+	BPF_STMT(BPF_ALU|BPF_SUB|BPF_K, 4),
+	BPF_STMT(BPF_MISC|BPF_TAX, 0),
+	BPF_STMT(BPF_LD|BPF_W|BPF_IND, 0),
+	BPF_STMT(BPF_ST, 0),
+	BPF_STMT(BPF_LD|BPF_H|BPF_IND, 2),
+	BPF_STMT(BPF_LDX|BPF_MEM, 0),
+	BPF_STMT(BPF_ALU|BPF_ADD|BPF_X, 0),
+	BPF_STMT(BPF_RET|BPF_A, 0),
+};
+
+static struct sock_filter load_past_end[] __initdata = {
+	BPF_STMT(BPF_LD|BPF_W|BPF_LEN, 0),
+	BPF_STMT(BPF_ALU|BPF_SUB|BPF_K, 2),
+	BPF_STMT(BPF_MISC|BPF_TAX, 0),
+	BPF_STMT(BPF_LD|BPF_W|BPF_IND, 0),
+	BPF_STMT(BPF_RET|BPF_K, 1),
+};
+
+static struct sock_filter ancillary[] __initdata = {
+	BPF_STMT(BPF_LD|BPF_H|BPF_ABS, SKF_AD_OFF + SKF_AD_PROTOCOL),
+	BPF_STMT(BPF_MISC|BPF_TAX, 0),
+	BPF_STMT(BPF_LD|BPF_W|BPF_ABS, SKF_AD_OFF + SKF_AD_MARK),
+	BPF_STMT(BPF_ALU|BPF_ADD|BPF_X, 0),
+	BPF_STMT(BPF_MISC|BPF_TAX, 0),
+	BPF_STMT(BPF_LD|BPF_B|BPF_ABS, SKF_NET_OFF + 9),
+	BPF_STMT(BPF_ALU|BPF_ADD|BPF_X, 0),
+	BPF_STMT(BPF_RET|BPF_A, 0),
+};
+
+/* X + k lands on an ancillary offset: sk_run_filter() loads the protocol */
+static struct sock_filter ancillary_ind[] __initdata = {
+	BPF_STMT(BPF_LDX|BPF_IMM, 4),
+	BPF_STMT(BPF_LD|BPF_W|BPF_IND, SKF_AD_OFF + SKF_AD_PROTOCOL - 4),
+	BPF_STMT(BPF_RET|BPF_A, 0),
+};
+
+static struct sock_filter jumps[] __initdata = {
+	BPF_STMT(BPF_LD|BPF_B|BPF_ABS, 14),
+	BPF_STMT(BPF_LDX|BPF_IMM, 0x40),
+	BPF_JUMP(BPF_JMP|BPF_JGT|BPF_X, 0, 0, 3),
+	BPF_JUMP(BPF_JMP|BPF_JSET|BPF_K, 0x4, 0, 2),
+	BPF_JUMP(BPF_JMP|BPF_JGE|BPF_K, 0x46, 1, 0),
+	BPF_STMT(BPF_JMP|BPF_JA, 1),
+	BPF_STMT(BPF_RET|BPF_K, 1),
+	BPF_STMT(BPF_RET|BPF_K, 2),
+};
+
+/* not handled by the JIT, must stay with the interpreter */
+static struct sock_filter pkttype[] __initdata = {
+	BPF_STMT(BPF_LD|BPF_B|BPF_ABS, SKF_AD_OFF + SKF_AD_PKTTYPE),
+	BPF_STMT(BPF_RET|BPF_A, 0),
+};
+
+#define BPF_TEST(prog) { #prog, prog, ARRAY_SIZE(prog) }
+
+static struct {
+	const char		*name;
+	struct sock_filter	*insns;
+	unsigned int		len;
+} bpf_tests[] __initdata = {
+	BPF_TEST(tcp_dport_22),
+	BPF_TEST(alu_ops),
+	BPF_TEST(div_by_zero),
+	BPF_TEST(load_tail),
+	BPF_TEST(load_past_end),
+	BPF_TEST(ancillary),
+	BPF_TEST(ancillary_ind),
+	BPF_TEST(jumps),
+	BPF_TEST(pkttype),
+};
+
+#define BPF_TEST_HLEN	(ETH_HLEN + 20 + 20)
+#define BPF_TEST_PLEN	64
+
+/* Ethernet, IPv4 and TCP headers of a packet to port 22 */
+static u8 bpf_test_hdr[BPF_TEST_HLEN] __initdata = {
+	0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x00, 0x66,
+	0x77, 0x88, 0x99, 0xaa, 0x08, 0x00,
+	0x45, 0x00, 0x00, 0x68, 0x12, 0x34, 0x40, 0x00,
+	0x40, 0x06, 0x00, 0x00, 0x0a, 0x00, 0x00, 0x01,
+	0x0a, 0x00, 0x00, 0x02,
+	0x9c, 0x40, 0x00, 0x16, 0x00, 0x00, 0x00, 0x01,
+	0x00, 0x00, 0x00, 0x00, 0x50, 0x02, 0x16, 0xd0,
+	0x00, 0x00, 0x00, 0x00,
+};
+
+static struct sk_buff * __init bpf_test_skb(unsigned int hlen,
+					   unsigned int plen, bool frag)
+{
+	struct sk_buff *skb;
+	struct page *page;
+	u8 *data;
+	int i;
+
+	skb = alloc_skb(BPF_TEST_HLEN + BPF_TEST_PLEN, GFP_KERNEL);
+	if (!skb)
+		return NULL;
+
+	memcpy(skb_put(skb, hlen), bpf_test_hdr, hlen);
+	if (frag) {
+		page = alloc_page(GFP_KERNEL);
+		if (!page) {
+			kfree_skb(skb);
+			return NULL;
+		}
+		data = page_address(page);
+		skb_fill_page_desc(skb, 0, page, 0, plen);
+		skb->len += plen;
+		skb->data_len += plen;
+		skb->truesize += plen;
+	} else
+		data = skb_put(skb, plen);
+	for (i = 0; i < plen; i++)
+		data[i] = i * 7;
+
+	skb->protocol = htons(ETH_P_IP);
+	skb->mark = 0x1234;
+	skb_reset_mac_header(skb);
+	skb_set_network_header(skb, ETH_HLEN);
+	return skb;
+}
+
+static int __init bpf_jit_selftest(void)
+{
+	struct sk_buff *skbs[3];
+	struct sk_filter *fp;
+	int enable = bpf_jit_enable;
+	int i, j, failed = 0;
+
+	skbs[0] = bpf_test_skb(BPF_TEST_HLEN, BPF_TEST_PLEN, false);
+	skbs[1] = bpf_test_skb(BPF_TEST_HLEN, BPF_TEST_PLEN, true);
+	skbs[2] = bpf_test_skb(ETH_HLEN + 10, 0, false);
+	if (!skbs[0] || !skbs[1] || !skbs[2]) {
+		pr_err("bpf_jit_selftest: out of memory\n");
+		goto out;
+	}
+
+	bpf_jit_enable = 1;
+	for (i = 0; i < ARRAY_SIZE(bpf_tests); i++) {
+		unsigned int fsize = bpf_tests[i].len * sizeof(struct sock_filter);
+
+		fp = kmalloc(sizeof(*fp) + fsize, GFP_KERNEL);
+		if (!fp) {
+			failed++;
+			continue;
+		}
+		memcpy(fp->insns, bpf_tests[i].insns, fsize);
+		fp->len = bpf_tests[i].len;
+		atomic_set(&fp->refcnt, 1);
+		fp->bpf_func = sk_run_filter;
+
+		if (sk_chk_filter(fp->insns, fp->len)) {
+			pr_err("bpf_jit_selftest: %s: rejected by sk_chk_filter\n",
+			       bpf_tests[i].name);
+			failed++;
+			kfree(fp);
+			continue;
+		}
+
+		bpf_jit_compile(fp);
+		if (fp->bpf_func == sk_run_filter)
+			pr_info("bpf_jit_selftest: %s: interpreted\n",
+				bpf_tests[i].name);
+
+		for (j = 0; j < ARRAY_SIZE(skbs); j++) {
+			unsigned int ret, jit_ret;
+
+			ret = sk_run_filter(skbs[j], fp->insns, fp->len);
+			jit_ret = SK_RUN_FILTER(fp, skbs[j]);
+			if (ret != jit_ret) {
+				pr_err("bpf_jit_selftest: %s: packet %d: "
+				       "interpreter %u, jit %u\n",
+				       bpf_tests[i].name, j, ret, jit_ret);
+				failed++;
+			}
+		}
+
+		bpf_jit_free(fp);
+		kfree(fp);
+	}
+	bpf_jit_enable = enable;
+
+	pr_info("bpf_jit_selftest: %zu filters, %d failures\n",
+		ARRAY_SIZE(bpf_tests), failed);
+out:
+	for (i = 0; i < ARRAY_SIZE(skbs); i++)
+		kfree_skb(skbs[i]);
+	return 0;
+}
+late_initcall(bpf_jit_selftest);
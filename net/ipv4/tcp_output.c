@@ -830,6 +830,12 @@ static int tcp_transmit_skb(struct sock *sk, struct sk_buff *skb, int clone_it,
 	if (tcp_packets_in_flight(tp) == 0)
 		tcp_ca_event(sk, CA_EVENT_TX_START);
 
+	/*
+	 * With nothing of ours left in the device queues, the flow may
+	 * move to another TX queue without risk of reordering.
+	 */
+	skb->ooo_okay = sk_wmem_alloc_get(sk) == 0;
+
 	skb_push(skb, tcp_header_size);
 	skb_reset_transport_header(skb);
 	skb_set_owner_w(skb, sk);
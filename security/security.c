@@ -565,6 +565,23 @@ int security_inode_permission(struct inode *inode, int mask)
 	return security_ops->inode_permission(inode, mask);
 }
 
+/*
+ * Check @mask from a context that may not sleep and holds dentry locks,
+ * as the lockless path walk does.  Security modules are allowed to block
+ * and to look up dentries while auditing, so unless the active module
+ * leaves the default hook in place this returns -EAGAIN and the caller
+ * must retry through security_inode_permission().
+ */
+int security_inode_permission_rcu(struct inode *inode, int mask)
+{
+	if (unlikely(IS_PRIVATE(inode)))
+		return 0;
+	if (security_ops->inode_permission !=
+	    default_security_ops.inode_permission)
+		return -EAGAIN;
+	return 0;
+}
+
 int security_inode_setattr(struct dentry *dentry, struct iattr *attr)
 {
 	if (unlikely(IS_PRIVATE(dentry->d_inode)))
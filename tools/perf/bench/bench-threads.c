@@ -0,0 +1,169 @@
+/*
+ *
+ * bench-threads.c
+ *
+ * Thread start barrier, timing loop and result output shared by the
+ * multi-threaded benchmarks.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "bench.h"
+#include "bench-threads.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/time.h>
+
+volatile int bench_done;
+
+static int threads_starting;
+static pthread_mutex_t thread_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t thread_parent = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t thread_worker = PTHREAD_COND_INITIALIZER;
+
+void barf(const char *msg)
+{
+	fprintf(stderr, "%s (error: %s)\n", msg, strerror(errno));
+	exit(1);
+}
+
+void bench_thread_wait_start(void)
+{
+	pthread_mutex_lock(&thread_lock);
+	if (!--threads_starting)
+		pthread_cond_signal(&thread_parent);
+	pthread_cond_wait(&thread_worker, &thread_lock);
+	pthread_mutex_unlock(&thread_lock);
+}
+
+static struct bench_thread *worker(void *workers, size_t size, int i)
+{
+	return (struct bench_thread *)((char *)workers + i * size);
+}
+
+void bench_threads_start(void *workers, size_t size, int nthreads,
+			 void *(*fn)(void *))
+{
+	struct bench_thread *w;
+	int i;
+
+	threads_starting = nthreads;
+	for (i = 0; i < nthreads; i++) {
+		w = worker(workers, size, i);
+		if (pthread_create(&w->thread, NULL, fn, w))
+			barf("pthread_create");
+	}
+
+	pthread_mutex_lock(&thread_lock);
+	while (threads_starting)
+		pthread_cond_wait(&thread_parent, &thread_lock);
+	pthread_cond_broadcast(&thread_worker);
+	pthread_mutex_unlock(&thread_lock);
+}
+
+unsigned long bench_threads_join(void *workers, size_t size, int nthreads)
+{
+	struct bench_thread *w;
+	unsigned long total = 0;
+	int i;
+
+	for (i = 0; i < nthreads; i++) {
+		w = worker(workers, size, i);
+		if (pthread_join(w->thread, NULL))
+			barf("pthread_join");
+		total += w->ops;
+	}
+
+	return total;
+}
+
+unsigned long bench_threads_run(void *workers, size_t size, int nthreads,
+				void *(*fn)(void *), int nsecs, double *secs)
+{
+	struct timeval start, stop, diff;
+	unsigned long total;
+
+	bench_done = 0;
+	bench_threads_start(workers, size, nthreads, fn);
+
+	gettimeofday(&start, NULL);
+	sleep(nsecs);
+	bench_done = 1;
+
+	total = bench_threads_join(workers, size, nthreads);
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+	*secs = diff.tv_sec + diff.tv_usec / 1000000.0;
+
+	return total;
+}
+
+static int print_header(const char *fmt, va_list ap)
+{
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		vprintf(fmt, ap);
+		printf("\n\n");
+		return 1;
+
+	case BENCH_FORMAT_SIMPLE:
+		return 0;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+}
+
+void bench_threads_print(const char *what, unsigned long total,
+			 double secs, int nthreads, const char *fmt, ...)
+{
+	char label[32];
+	va_list ap;
+	int verbose;
+
+	va_start(ap, fmt);
+	verbose = print_header(fmt, ap);
+	va_end(ap);
+
+	if (!verbose) {
+		printf("%.0f\n", total / secs);
+		return;
+	}
+
+	snprintf(label, sizeof(label), "Total %s", what);
+	printf(" %14s: %lu\n", label, total);
+	printf(" %14.0f %s/sec\n", total / secs, what);
+	printf(" %14.0f %s/sec per thread\n", total / secs / nthreads, what);
+}
+
+void bench_threads_print_time(const char *what, unsigned long long usecs,
+			      int iterations, int nthreads,
+			      const char *fmt, ...)
+{
+	char label[32];
+	va_list ap;
+	int verbose;
+
+	va_start(ap, fmt);
+	verbose = print_header(fmt, ap);
+	va_end(ap);
+
+	if (!verbose) {
+		printf("%.3f\n", (double)usecs / iterations / 1000);
+		return;
+	}
+
+	snprintf(label, sizeof(label), "Avg %s time", what);
+	printf(" %14s: %.3f [msec]\n", label,
+	       (double)usecs / iterations / 1000);
+	printf(" %14lf usecs/%s\n",
+	       (double)usecs / iterations / nthreads, what);
+}
@@ -0,0 +1,69 @@
+/*
+ * bench-threads.h
+ *
+ * Harness shared by the benchmarks that run a worker function in a
+ * number of threads: start them all at once, time them and print the
+ * result in bench_format.
+ */
+
+#ifndef BENCH_THREADS_H
+#define BENCH_THREADS_H
+
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "../util/util.h"
+
+/*
+ * Every per-thread structure passed to bench_threads_start() begins with
+ * one of these. Workers count what they did in ops.
+ */
+struct bench_thread {
+	pthread_t	thread;
+	unsigned long	ops;
+};
+
+/* set by bench_threads_run() when the workers have to stop */
+extern volatile int bench_done;
+
+extern NORETURN void barf(const char *msg);
+
+/* first thing in a worker: wait until every thread has been created */
+extern void bench_thread_wait_start(void);
+
+/*
+ * Start nthreads threads running fn, the i'th one passed the i'th
+ * element of workers, each of them size bytes long, and release them
+ * together once all are up. bench_threads_join() waits for them and
+ * returns the sum of their ops.
+ */
+extern void bench_threads_start(void *workers, size_t size, int nthreads,
+				void *(*fn)(void *));
+extern unsigned long bench_threads_join(void *workers, size_t size,
+					int nthreads);
+
+/*
+ * Start the threads, let them run for nsecs seconds and join them.
+ * Returns their ops, and the time they really ran in *secs.
+ */
+extern unsigned long bench_threads_run(void *workers, size_t size,
+				       int nthreads, void *(*fn)(void *),
+				       int nsecs, double *secs);
+
+/*
+ * Print the result of a run: total ops over secs seconds for the
+ * throughput benchmarks, or usecs for iterations rounds of a timed
+ * operation. The header is only printed in the default format, where
+ * the caller may add lines of its own after the call returns.
+ */
+extern void bench_threads_print(const char *what, unsigned long total,
+				double secs, int nthreads,
+				const char *fmt, ...)
+	__attribute__((format(printf, 5, 6)));
+extern void bench_threads_print_time(const char *what,
+				     unsigned long long usecs,
+				     int iterations, int nthreads,
+				     const char *fmt, ...)
+	__attribute__((format(printf, 5, 6)));
+
+#endif /* BENCH_THREADS_H */
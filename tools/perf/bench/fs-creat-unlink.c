@@ -0,0 +1,134 @@
+/*
+ *
+ * fs-creat-unlink.c
+ *
+ * creat-unlink: Benchmark for inode and dentry creation and teardown
+ *
+ * Every thread repeatedly creates a file, closes it and unlinks it
+ * again. Each round allocates an inode, hashes it, puts it on the
+ * superblock's inode list and then evicts it, so this measures how the
+ * inode cache locking scales with the number of threads. By default
+ * every thread works in its own directory, which keeps the parent's
+ * i_mutex out of the picture; --shared puts them all in one directory.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+#include "bench-threads.h"
+
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+static int nthreads;
+static int nsecs = 10;
+static int shared;
+static const char *dir = "/tmp";
+
+struct worker {
+	struct bench_thread bt;
+	int id;
+	char path[PATH_MAX];
+};
+
+static const struct option options[] = {
+	OPT_INTEGER('t', "threads", &nthreads,
+		    "Specify number of threads (default: number of cpus)"),
+	OPT_INTEGER('r', "runtime", &nsecs,
+		    "Specify runtime (in seconds)"),
+	OPT_STRING('d', "directory", &dir, "path",
+		   "Specify directory to create the files in"),
+	OPT_BOOLEAN('s', "shared", &shared,
+		    "All threads use the same directory"),
+	OPT_END()
+};
+
+static const char * const bench_fs_creat_unlink_usage[] = {
+	"perf bench fs creat-unlink <options>",
+	NULL
+};
+
+static void *workerfn(void *arg)
+{
+	struct worker *w = arg;
+	char name[PATH_MAX];
+	unsigned long ops = 0;
+	int fd;
+
+	snprintf(name, sizeof(name), "%s/file-%d", w->path, w->id);
+
+	bench_thread_wait_start();
+
+	do {
+		fd = creat(name, 0600);
+		if (fd < 0)
+			barf("creat");
+		close(fd);
+		if (unlink(name))
+			barf("unlink");
+		ops++;
+	} while (!bench_done);
+
+	w->bt.ops = ops;
+	return NULL;
+}
+
+int bench_fs_creat_unlink(int argc, const char **argv,
+			  const char *prefix __used)
+{
+	struct worker *workers;
+	char top[PATH_MAX];
+	unsigned long total;
+	double secs;
+	int i;
+
+	argc = parse_options(argc, argv, options,
+			     bench_fs_creat_unlink_usage, 0);
+
+	if (nthreads <= 0)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nthreads <= 0 || nsecs <= 0)
+		usage_with_options(bench_fs_creat_unlink_usage, options);
+
+	workers = calloc(nthreads, sizeof(*workers));
+	if (!workers)
+		barf("calloc");
+
+	snprintf(top, sizeof(top), "%s/perf-bench-fs.XXXXXX", dir);
+	if (!mkdtemp(top))
+		barf("mkdtemp");
+
+	for (i = 0; i < nthreads; i++) {
+		workers[i].id = i;
+		if (shared) {
+			strcpy(workers[i].path, top);
+			continue;
+		}
+		snprintf(workers[i].path, sizeof(workers[i].path),
+			 "%s/%d", top, i);
+		if (mkdir(workers[i].path, 0700))
+			barf("mkdir");
+	}
+
+	total = bench_threads_run(workers, sizeof(*workers), nthreads,
+				  workerfn, nsecs, &secs);
+
+	for (i = 0; i < nthreads && !shared; i++)
+		rmdir(workers[i].path);
+	rmdir(top);
+
+	bench_threads_print("loops", total, secs, nthreads,
+			    "# %d threads creating and unlinking files in %s"
+			    " director%s for %d secs", nthreads,
+			    shared ? "one" : "their own",
+			    shared ? "y" : "ies", nsecs);
+
+	free(workers);
+	return 0;
+}
@@ -0,0 +1,108 @@
+/*
+ *
+ * futex-hash.c
+ *
+ * hash: Benchmark for the futex hash table
+ *
+ * Every thread repeatedly issues FUTEX_WAIT on its own set of private
+ * futexes with a value that never matches, so that each call only hashes
+ * the key and takes the bucket lock before returning -EWOULDBLOCK. This
+ * measures the throughput of the hash table and the contention on its
+ * bucket locks.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+#include "bench-threads.h"
+#include "futex.h"
+
+#include <stdlib.h>
+#include <errno.h>
+
+static int nthreads;
+static int nfutexes = 1024;
+static int nsecs = 10;
+
+struct worker {
+	struct bench_thread bt;
+	u_int32_t *futex;
+};
+
+static const struct option options[] = {
+	OPT_INTEGER('t', "threads", &nthreads,
+		    "Specify number of threads (default: number of cpus)"),
+	OPT_INTEGER('f', "futexes", &nfutexes,
+		    "Specify number of futexes per thread"),
+	OPT_INTEGER('r', "runtime", &nsecs,
+		    "Specify runtime (in seconds)"),
+	OPT_END()
+};
+
+static const char * const bench_futex_hash_usage[] = {
+	"perf bench futex hash <options>",
+	NULL
+};
+
+static void *workerfn(void *arg)
+{
+	struct worker *w = arg;
+	unsigned long ops = 0;
+	int i;
+
+	bench_thread_wait_start();
+
+	do {
+		for (i = 0; i < nfutexes; i++, ops++) {
+			/* the futex word is 0: never sleeps */
+			if (futex_wait(&w->futex[i], 1234) != -1 ||
+			    errno != EWOULDBLOCK)
+				barf("futex_wait");
+		}
+	} while (!bench_done);
+
+	w->bt.ops = ops;
+	return NULL;
+}
+
+int bench_futex_hash(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	struct worker *workers;
+	unsigned long total;
+	double secs;
+	int i;
+
+	argc = parse_options(argc, argv, options,
+			     bench_futex_hash_usage, 0);
+
+	if (nthreads <= 0)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nthreads <= 0 || nfutexes <= 0 || nsecs <= 0)
+		usage_with_options(bench_futex_hash_usage, options);
+
+	workers = calloc(nthreads, sizeof(*workers));
+	if (!workers)
+		barf("calloc");
+
+	for (i = 0; i < nthreads; i++) {
+		workers[i].futex = calloc(nfutexes, sizeof(u_int32_t));
+		if (!workers[i].futex)
+			barf("calloc");
+	}
+
+	total = bench_threads_run(workers, sizeof(*workers), nthreads,
+				  workerfn, nsecs, &secs);
+
+	bench_threads_print("ops", total, secs, nthreads,
+			    "# %d threads operating on %d private futexes"
+			    " each for %d secs", nthreads, nfutexes, nsecs);
+
+	for (i = 0; i < nthreads; i++)
+		free(workers[i].futex);
+	free(workers);
+	return 0;
+}
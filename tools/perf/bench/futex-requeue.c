@@ -0,0 +1,120 @@
+/*
+ *
+ * futex-requeue.c
+ *
+ * requeue: Benchmark for FUTEX_CMP_REQUEUE
+ *
+ * Blocks a number of threads on a private futex and measures how long
+ * it takes to requeue all of them to a second futex, a given number of
+ * waiters per call, the way condition variable broadcasts do.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+#include "bench-threads.h"
+#include "futex.h"
+
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/time.h>
+
+static int nthreads;
+static int nrequeue = 1;
+static int iterations = 10;
+
+static u_int32_t futex1, futex2;
+
+static const struct option options[] = {
+	OPT_INTEGER('t', "threads", &nthreads,
+		    "Specify number of threads (default: number of cpus)"),
+	OPT_INTEGER('q', "nrequeue", &nrequeue,
+		    "Specify number of threads to requeue per call"),
+	OPT_INTEGER('i', "iterations", &iterations,
+		    "Specify number of iterations"),
+	OPT_END()
+};
+
+static const char * const bench_futex_requeue_usage[] = {
+	"perf bench futex requeue <options>",
+	NULL
+};
+
+static void *workerfn(void *arg __used)
+{
+	bench_thread_wait_start();
+
+	/* retry on spurious wakeups and signals */
+	while (futex_wait(&futex1, 0) && errno != EWOULDBLOCK)
+		;
+
+	return NULL;
+}
+
+int bench_futex_requeue(int argc, const char **argv,
+			const char *prefix __used)
+{
+	struct bench_thread *threads;
+	struct timeval start, stop, diff;
+	unsigned long long total_usec = 0;
+	int j, moved, ret;
+
+	argc = parse_options(argc, argv, options,
+			     bench_futex_requeue_usage, 0);
+
+	if (nthreads <= 0)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nthreads <= 0 || nrequeue <= 0 || iterations <= 0)
+		usage_with_options(bench_futex_requeue_usage, options);
+
+	threads = calloc(nthreads, sizeof(*threads));
+	if (!threads)
+		barf("calloc");
+
+	for (j = 0; j < iterations; j++) {
+		futex1 = 0;
+		bench_threads_start(threads, sizeof(*threads), nthreads,
+				    workerfn);
+
+		/* give the threads time to go to sleep on the futex */
+		usleep(100000);
+
+		/*
+		 * Only the requeueing is timed. Keep going until every
+		 * thread was moved, in case some of them had not blocked
+		 * yet.
+		 */
+		moved = 0;
+		gettimeofday(&start, NULL);
+		while (moved < nthreads) {
+			ret = futex_cmp_requeue(&futex1, 0, &futex2,
+						0, nrequeue);
+			if (ret < 0)
+				barf("futex_cmp_requeue");
+			moved += ret;
+		}
+		gettimeofday(&stop, NULL);
+		timersub(&stop, &start, &diff);
+		total_usec += diff.tv_sec * 1000000ULL + diff.tv_usec;
+
+		moved = 0;
+		while (moved < nthreads) {
+			ret = futex_wake(&futex2, nthreads);
+			if (ret < 0)
+				barf("futex_wake");
+			moved += ret;
+		}
+
+		bench_threads_join(threads, sizeof(*threads), nthreads);
+	}
+
+	bench_threads_print_time("requeue", total_usec, iterations, nthreads,
+				 "# Requeued %d threads, %d per call, %d times",
+				 nthreads, nrequeue, iterations);
+
+	free(threads);
+	return 0;
+}
@@ -0,0 +1,111 @@
+/*
+ *
+ * futex-wake.c
+ *
+ * wake: Benchmark for FUTEX_WAKE
+ *
+ * Blocks a number of threads on a single private futex, then measures
+ * how long it takes to wake all of them up, a given number of waiters
+ * per FUTEX_WAKE call.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+#include "bench-threads.h"
+#include "futex.h"
+
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/time.h>
+
+static int nthreads;
+static int nwakes = 1;
+static int iterations = 10;
+
+static u_int32_t futex1;
+
+static const struct option options[] = {
+	OPT_INTEGER('t', "threads", &nthreads,
+		    "Specify number of threads (default: number of cpus)"),
+	OPT_INTEGER('w', "nwakes", &nwakes,
+		    "Specify number of threads to wake up per call"),
+	OPT_INTEGER('i', "iterations", &iterations,
+		    "Specify number of iterations"),
+	OPT_END()
+};
+
+static const char * const bench_futex_wake_usage[] = {
+	"perf bench futex wake <options>",
+	NULL
+};
+
+static void *workerfn(void *arg __used)
+{
+	bench_thread_wait_start();
+
+	/* retry on spurious wakeups and signals */
+	while (futex_wait(&futex1, 0) && errno != EWOULDBLOCK)
+		;
+
+	return NULL;
+}
+
+int bench_futex_wake(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	struct bench_thread *threads;
+	struct timeval start, stop, diff;
+	unsigned long long total_usec = 0;
+	int j, woken, ret;
+
+	argc = parse_options(argc, argv, options,
+			     bench_futex_wake_usage, 0);
+
+	if (nthreads <= 0)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nthreads <= 0 || nwakes <= 0 || iterations <= 0)
+		usage_with_options(bench_futex_wake_usage, options);
+
+	threads = calloc(nthreads, sizeof(*threads));
+	if (!threads)
+		barf("calloc");
+
+	for (j = 0; j < iterations; j++) {
+		futex1 = 0;
+		bench_threads_start(threads, sizeof(*threads), nthreads,
+				    workerfn);
+
+		/* give the threads time to go to sleep on the futex */
+		usleep(100000);
+
+		/*
+		 * Only the FUTEX_WAKE calls are timed. Keep going until
+		 * every thread was woken, in case some of them had not
+		 * blocked yet.
+		 */
+		woken = 0;
+		gettimeofday(&start, NULL);
+		while (woken < nthreads) {
+			ret = futex_wake(&futex1, nwakes);
+			if (ret < 0)
+				barf("futex_wake");
+			woken += ret;
+		}
+		gettimeofday(&stop, NULL);
+		timersub(&stop, &start, &diff);
+		total_usec += diff.tv_sec * 1000000ULL + diff.tv_usec;
+
+		bench_threads_join(threads, sizeof(*threads), nthreads);
+	}
+
+	bench_threads_print_time("wakeup", total_usec, iterations, nthreads,
+				 "# Woke up %d threads, %d per call, %d times",
+				 nthreads, nwakes, iterations);
+
+	free(threads);
+	return 0;
+}
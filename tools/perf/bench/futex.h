@@ -0,0 +1,44 @@
+/*
+ * futex.h
+ *
+ * Thin wrappers around the futex() system call for the futex
+ * benchmarks: glibc doesn't provide one.
+ */
+
+#ifndef _FUTEX_H
+#define _FUTEX_H
+
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <linux/futex.h>
+
+#define futex(uaddr, op, val, timeout, uaddr2, val3)			\
+	syscall(SYS_futex, uaddr, op | FUTEX_PRIVATE_FLAG, val,	\
+		timeout, uaddr2, val3)
+
+/* sleep on uaddr as long as it still contains val */
+static inline int futex_wait(u_int32_t *uaddr, u_int32_t val)
+{
+	return futex(uaddr, FUTEX_WAIT, val, NULL, NULL, 0);
+}
+
+/* wake up to nr_wake waiters of uaddr */
+static inline int futex_wake(u_int32_t *uaddr, int nr_wake)
+{
+	return futex(uaddr, FUTEX_WAKE, nr_wake, NULL, NULL, 0);
+}
+
+/*
+ * wake up to nr_wake waiters of uaddr and move up to nr_requeue of the
+ * remaining ones to uaddr2, provided uaddr still contains val
+ */
+static inline int futex_cmp_requeue(u_int32_t *uaddr, u_int32_t val,
+				    u_int32_t *uaddr2, int nr_wake,
+				    int nr_requeue)
+{
+	return futex(uaddr, FUTEX_CMP_REQUEUE, nr_wake,
+		     (void *)(long)nr_requeue, uaddr2, val);
+}
+
+#endif /* _FUTEX_H */
@@ -0,0 +1,102 @@
+/*
+ *
+ * mem-mmap.c
+ *
+ * mmap: Benchmark for mmap_sem contention
+ *
+ * Every thread repeatedly maps an anonymous region, touches each of its
+ * pages and unmaps it again. All threads share one mm, so mmap() and
+ * munmap() take mmap_sem for writing while the page faults in between
+ * take it for reading. This measures how well the rw_semaphore copes
+ * with a mix of short writer and reader critical sections.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+#include "bench-threads.h"
+
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+static int nthreads;
+static int npages = 16;
+static int nsecs = 10;
+
+static const struct option options[] = {
+	OPT_INTEGER('t', "threads", &nthreads,
+		    "Specify number of threads (default: number of cpus)"),
+	OPT_INTEGER('p', "pages", &npages,
+		    "Specify number of pages mapped and faulted per loop"),
+	OPT_INTEGER('r', "runtime", &nsecs,
+		    "Specify runtime (in seconds)"),
+	OPT_END()
+};
+
+static const char * const bench_mem_mmap_usage[] = {
+	"perf bench mem mmap <options>",
+	NULL
+};
+
+static void *workerfn(void *arg)
+{
+	struct bench_thread *w = arg;
+	size_t page_size = sysconf(_SC_PAGESIZE);
+	size_t len = npages * page_size;
+	unsigned long ops = 0;
+	char *p;
+	size_t off;
+
+	bench_thread_wait_start();
+
+	do {
+		p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED)
+			barf("mmap");
+		for (off = 0; off < len; off += page_size)
+			p[off] = 1;
+		if (munmap(p, len))
+			barf("munmap");
+		ops++;
+	} while (!bench_done);
+
+	w->ops = ops;
+	return NULL;
+}
+
+int bench_mem_mmap(int argc, const char **argv,
+		   const char *prefix __used)
+{
+	struct bench_thread *workers;
+	unsigned long total;
+	double secs;
+
+	argc = parse_options(argc, argv, options,
+			     bench_mem_mmap_usage, 0);
+
+	if (nthreads <= 0)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nthreads <= 0 || npages <= 0 || nsecs <= 0)
+		usage_with_options(bench_mem_mmap_usage, options);
+
+	workers = calloc(nthreads, sizeof(*workers));
+	if (!workers)
+		barf("calloc");
+
+	total = bench_threads_run(workers, sizeof(*workers), nthreads,
+				  workerfn, nsecs, &secs);
+
+	bench_threads_print("loops", total, secs, nthreads,
+			    "# %d threads mapping, faulting and unmapping"
+			    " %d pages for %d secs", nthreads, npages, nsecs);
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf(" %14.0f faults/sec\n", total * npages / secs);
+
+	free(workers);
+	return 0;
+}
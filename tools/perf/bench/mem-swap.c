@@ -0,0 +1,125 @@
+/*
+ *
+ * mem-swap.c
+ *
+ * swap: Benchmark for swap out and swap in under memory pressure
+ *
+ * Every thread maps its own share of an anonymous region bigger than
+ * memory and keeps writing to each of its pages in turn. Once memory is
+ * full, every page touched has to be swapped in, and some other page
+ * swapped out to make room, by all threads at once. This measures how
+ * well swap slot allocation and swap I/O scale with the number of
+ * reclaiming cpus.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+#include "bench-threads.h"
+
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+static int nthreads;
+static int size_mb;
+static int nsecs = 30;
+
+struct worker {
+	struct bench_thread bt;
+	char *area;
+	size_t len;
+};
+
+static const struct option options[] = {
+	OPT_INTEGER('t', "threads", &nthreads,
+		    "Specify number of threads (default: number of cpus)"),
+	OPT_INTEGER('s', "size", &size_mb,
+		    "Specify total size in MB (default: 1.5 times memory)"),
+	OPT_INTEGER('r', "runtime", &nsecs,
+		    "Specify runtime (in seconds)"),
+	OPT_END()
+};
+
+static const char * const bench_mem_swap_usage[] = {
+	"perf bench mem swap <options>",
+	NULL
+};
+
+static void *workerfn(void *arg)
+{
+	struct worker *w = arg;
+	size_t page_size = sysconf(_SC_PAGESIZE);
+	unsigned long pages = 0;
+	size_t off = 0;
+
+	bench_thread_wait_start();
+
+	do {
+		w->area[off]++;
+		off += page_size;
+		if (off >= w->len)
+			off = 0;
+		pages++;
+	} while (!bench_done);
+
+	w->bt.ops = pages;
+	return NULL;
+}
+
+int bench_mem_swap(int argc, const char **argv,
+		   const char *prefix __used)
+{
+	struct worker *workers;
+	unsigned long total;
+	size_t page_size = sysconf(_SC_PAGESIZE);
+	size_t len;
+	double secs;
+	int i;
+
+	argc = parse_options(argc, argv, options,
+			     bench_mem_swap_usage, 0);
+
+	if (nthreads <= 0)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (size_mb <= 0)
+		size_mb = (double)sysconf(_SC_PHYS_PAGES) * page_size *
+			  3 / 2 / (1024 * 1024);
+	if (nthreads <= 0 || size_mb <= 0 || nsecs <= 0)
+		usage_with_options(bench_mem_swap_usage, options);
+
+	len = (size_t)size_mb * 1024 * 1024 / nthreads;
+	len -= len % page_size;
+	if (!len)
+		usage_with_options(bench_mem_swap_usage, options);
+
+	workers = calloc(nthreads, sizeof(*workers));
+	if (!workers)
+		barf("calloc");
+
+	for (i = 0; i < nthreads; i++) {
+		workers[i].len = len;
+		workers[i].area = mmap(NULL, len, PROT_READ | PROT_WRITE,
+				       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (workers[i].area == MAP_FAILED)
+			barf("mmap");
+	}
+
+	total = bench_threads_run(workers, sizeof(*workers), nthreads,
+				  workerfn, nsecs, &secs);
+
+	bench_threads_print("pages", total, secs, nthreads,
+			    "# %d threads writing %d MB of anonymous memory"
+			    " for %d secs", nthreads, size_mb, nsecs);
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf(" %14.3f MB/sec\n",
+		       total * page_size / secs / (1024 * 1024));
+
+	for (i = 0; i < nthreads; i++)
+		munmap(workers[i].area, workers[i].len);
+	free(workers);
+	return 0;
+}
@@ -13,6 +13,8 @@
  * Available subsystem list:
  *  sched ... scheduler and IPC mechanism
  *  mem   ... memory access performance
+ *  futex ... futex hash table and wake/requeue operations
+ *  fs    ... inode and dentry cache scalability
  *
  */
 
@@ -52,6 +54,38 @@ static struct bench_suite mem_suites[] = {
 	{ "memcpy",
 	  "Simple memory copy in various ways",
 	  bench_mem_memcpy },
+	{ "mmap",
+	  "Benchmark for mmap/munmap and page faults on one mm",
+	  bench_mem_mmap },
+	{ "swap",
+	  "Benchmark for swap out and in by many threads at once",
+	  bench_mem_swap },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL             }
+};
+
+static struct bench_suite futex_suites[] = {
+	{ "hash",
+	  "Benchmark for futex hash table",
+	  bench_futex_hash },
+	{ "wake",
+	  "Benchmark for futex wake calls",
+	  bench_futex_wake },
+	{ "requeue",
+	  "Benchmark for futex requeue calls",
+	  bench_futex_requeue },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL             }
+};
+
+static struct bench_suite fs_suites[] = {
+	{ "creat-unlink",
+	  "Benchmark for creat/unlink by many threads at once",
+	  bench_fs_creat_unlink },
 	suite_all,
 	{ NULL,
 	  NULL,
@@ -71,6 +105,12 @@ static struct bench_subsys subsystems[] = {
 	{ "mem",
 	  "memory access performance",
 	  mem_suites },
+	{ "futex",
+	  "futex stressing benchmarks",
+	  futex_suites },
+	{ "fs",
+	  "filesystem inode and dentry cache benchmarks",
+	  fs_suites },
 	{ "all",		/* sentinel: easy for help */
 	  "test all subsystem (pseudo subsystem)",
 	  NULL },